@@ -1,15 +1,27 @@
 #include "ast.h"
+#include "stats.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdarg.h>
 
 ASTNode* ast_node_create(ASTNodeType type) {
-    ASTNode *node = (ASTNode*)malloc(sizeof(ASTNode));
+    ASTNode *node = (ASTNode*)stats_malloc(sizeof(ASTNode));
     node->type = type;
+    node->line = 0;
+    node->column = 0;
     memset(&node->data, 0, sizeof(node->data));
     return node;
 }
 
+// Create a node positioned at token
+static ASTNode* ast_node_at(ASTNodeType type, Token token) {
+    ASTNode *node = ast_node_create(type);
+    node->line = token.line;
+    node->column = token.column;
+    return node;
+}
+
 void ast_node_free(ASTNode *node) {
     if (!node) return;
     
@@ -74,10 +86,43 @@ void ast_print(ASTNode *node, int indent) {
     }
 }
 
+int ast_count_nodes(ASTNode *node) {
+    if (!node) return 0;
+
+    switch (node->type) {
+        case AST_PROGRAM: {
+            int count = 1;
+            for (int i = 0; i < node->data.program.statement_count; i++) {
+                count += ast_count_nodes(node->data.program.statements[i]);
+            }
+            return count;
+        }
+        case AST_VARIABLE_DECLARATION:
+            return 1 + ast_count_nodes(node->data.variable_declaration.value);
+        case AST_PRINT_STATEMENT:
+            return 1 + ast_count_nodes(node->data.print_statement.expression);
+        case AST_BINARY_EXPRESSION:
+            return 1 + ast_count_nodes(node->data.binary_expression.left) +
+                   ast_count_nodes(node->data.binary_expression.right);
+        case AST_IDENTIFIER:
+        case AST_NUMBER:
+            return 1;
+    }
+    return 1;
+}
+
 Parser* parser_create(TokenArray *tokens) {
-    Parser *parser = (Parser*)malloc(sizeof(Parser));
+    Parser *parser = (Parser*)stats_malloc(sizeof(Parser));
     parser->tokens = tokens;
     parser->current = 0;
+    parser->had_error = 0;
+    parser->error[0] = '\0';
+
+    // Tokenizer errors already carry their position
+    if (tokens->had_error) {
+        parser->had_error = 1;
+        snprintf(parser->error, sizeof(parser->error), "%s", tokens->error);
+    }
     return parser;
 }
 
@@ -85,10 +130,34 @@ void parser_free(Parser *parser) {
     free(parser);
 }
 
+void parser_error(Parser *parser, const char *format, ...) {
+    // Keep only the first error; later ones are usually follow-on noise
+    if (parser->had_error) return;
+    parser->had_error = 1;
+
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(parser->error, sizeof(parser->error), format, args);
+    va_end(args);
+
+    Token token = parser_current_token(parser);
+    if (token.line > 0 && length >= 0 && (size_t)length < sizeof(parser->error)) {
+        snprintf(parser->error + length, sizeof(parser->error) - length,
+                 " at line %d, column %d", token.line, token.column);
+    }
+}
+
 Token parser_current_token(Parser *parser) {
     if (parser->current >= parser->tokens->count) {
+        // End of input sits where the last token was
         Token eof_token;
         eof_token.type = TOKEN_UNKNOWN;
+        eof_token.line = 0;
+        eof_token.column = 0;
+        if (parser->tokens->count > 0) {
+            eof_token.line = parser->tokens->tokens[parser->tokens->count - 1].line;
+            eof_token.column = parser->tokens->tokens[parser->tokens->count - 1].column;
+        }
         return eof_token;
     }
     return parser->tokens->tokens[parser->current];
@@ -100,9 +169,10 @@ Token parser_consume(Parser *parser, TokenType expected) {
         parser->current++;
         return token;
     } else {
-        printf("Parser error: Expected %s but got %s\n", 
-               token_type_to_string(expected), token_type_to_string(token.type));
-        exit(1);
+        parser_error(parser, "Expected %s but got %s",
+                     token_type_to_string(expected), token_type_to_string(token.type));
+        token.type = TOKEN_UNKNOWN;
+        return token;
     }
 }
 
@@ -116,16 +186,16 @@ int parser_match(Parser *parser, TokenType type) {
 
 ASTNode* parse_program(Parser *parser) {
     ASTNode *program = ast_node_create(AST_PROGRAM);
-    program->data.program.statements = (ASTNode**)malloc(sizeof(ASTNode*) * 10);
+    program->data.program.statements = (ASTNode**)stats_malloc(sizeof(ASTNode*) * 10);
     program->data.program.statement_count = 0;
     program->data.program.statement_capacity = 10;
     
-    while (parser->current < parser->tokens->count) {
+    while (!parser->had_error && parser->current < parser->tokens->count) {
         ASTNode *stmt = parse_statement(parser);
         if (stmt) {
             if (program->data.program.statement_count >= program->data.program.statement_capacity) {
                 program->data.program.statement_capacity *= 2;
-                program->data.program.statements = (ASTNode**)realloc(
+                program->data.program.statements = (ASTNode**)stats_realloc(
                     program->data.program.statements, 
                     sizeof(ASTNode*) * program->data.program.statement_capacity);
             }
@@ -145,31 +215,42 @@ ASTNode* parse_statement(Parser *parser) {
         return parse_print_statement(parser);
     }
     
+    parser_error(parser, "Unexpected token %s at start of statement", token_type_to_string(current.type));
     return NULL;
 }
 
 ASTNode* parse_variable_declaration(Parser *parser) {
-    parser_consume(parser, TOKEN_LET);
+    Token let_token = parser_consume(parser, TOKEN_LET);
     Token name_token = parser_consume(parser, TOKEN_IDENTIFIER);
     parser_consume(parser, TOKEN_EQUALS);
+    if (parser->had_error) return NULL;
     ASTNode *value = parse_expression(parser);
     parser_consume(parser, TOKEN_SEMICOLON);
+    if (parser->had_error) {
+        ast_node_free(value);
+        return NULL;
+    }
     
-    ASTNode *var_decl = ast_node_create(AST_VARIABLE_DECLARATION);
-    var_decl->data.variable_declaration.name = strdup(name_token.value.string_value);
+    ASTNode *var_decl = ast_node_at(AST_VARIABLE_DECLARATION, let_token);
+    var_decl->data.variable_declaration.name = stats_strdup(name_token.value.string_value);
     var_decl->data.variable_declaration.value = value;
     
     return var_decl;
 }
 
 ASTNode* parse_print_statement(Parser *parser) {
-    parser_consume(parser, TOKEN_PRINT);
+    Token print_token = parser_consume(parser, TOKEN_PRINT);
     parser_consume(parser, TOKEN_LPAREN);
+    if (parser->had_error) return NULL;
     ASTNode *expression = parse_expression(parser);
     parser_consume(parser, TOKEN_RPAREN);
     parser_consume(parser, TOKEN_SEMICOLON);
+    if (parser->had_error) {
+        ast_node_free(expression);
+        return NULL;
+    }
     
-    ASTNode *print_stmt = ast_node_create(AST_PRINT_STATEMENT);
+    ASTNode *print_stmt = ast_node_at(AST_PRINT_STATEMENT, print_token);
     print_stmt->data.print_statement.expression = expression;
     
     return print_stmt;
@@ -177,17 +258,22 @@ ASTNode* parse_print_statement(Parser *parser) {
 
 ASTNode* parse_expression(Parser *parser) {
     ASTNode *left = parse_term(parser);
+    if (!left) return NULL;
     
     while (parser_current_token(parser).type == TOKEN_PLUS || 
            parser_current_token(parser).type == TOKEN_MINUS) {
-        TokenType op = parser_current_token(parser).type;
+        Token op = parser_current_token(parser);
         parser->current++;
         ASTNode *right = parse_term(parser);
+        if (!right) {
+            ast_node_free(left);
+            return NULL;
+        }
         
-        ASTNode *binary = ast_node_create(AST_BINARY_EXPRESSION);
+        ASTNode *binary = ast_node_at(AST_BINARY_EXPRESSION, op);
         binary->data.binary_expression.left = left;
         binary->data.binary_expression.right = right;
-        binary->data.binary_expression.operator = op;
+        binary->data.binary_expression.operator = op.type;
         left = binary;
     }
     
@@ -196,17 +282,22 @@ ASTNode* parse_expression(Parser *parser) {
 
 ASTNode* parse_term(Parser *parser) {
     ASTNode *left = parse_factor(parser);
+    if (!left) return NULL;
     
     while (parser_current_token(parser).type == TOKEN_STAR || 
            parser_current_token(parser).type == TOKEN_SLASH) {
-        TokenType op = parser_current_token(parser).type;
+        Token op = parser_current_token(parser);
         parser->current++;
         ASTNode *right = parse_factor(parser);
+        if (!right) {
+            ast_node_free(left);
+            return NULL;
+        }
         
-        ASTNode *binary = ast_node_create(AST_BINARY_EXPRESSION);
+        ASTNode *binary = ast_node_at(AST_BINARY_EXPRESSION, op);
         binary->data.binary_expression.left = left;
         binary->data.binary_expression.right = right;
-        binary->data.binary_expression.operator = op;
+        binary->data.binary_expression.operator = op.type;
         left = binary;
     }
     
@@ -218,21 +309,25 @@ ASTNode* parse_factor(Parser *parser) {
     
     if (current.type == TOKEN_NUMBER) {
         parser->current++;
-        ASTNode *number = ast_node_create(AST_NUMBER);
+        ASTNode *number = ast_node_at(AST_NUMBER, current);
         number->data.number.value = current.value.number_value;
         return number;
     } else if (current.type == TOKEN_IDENTIFIER) {
         parser->current++;
-        ASTNode *identifier = ast_node_create(AST_IDENTIFIER);
-        identifier->data.identifier.name = strdup(current.value.string_value);
+        ASTNode *identifier = ast_node_at(AST_IDENTIFIER, current);
+        identifier->data.identifier.name = stats_strdup(current.value.string_value);
         return identifier;
     } else if (current.type == TOKEN_LPAREN) {
         parser->current++;
         ASTNode *expression = parse_expression(parser);
         parser_consume(parser, TOKEN_RPAREN);
+        if (parser->had_error) {
+            ast_node_free(expression);
+            return NULL;
+        }
         return expression;
     }
     
-    printf("Parser error: Unexpected token %s\n", token_type_to_string(current.type));
-    exit(1);
+    parser_error(parser, "Unexpected token %s", token_type_to_string(current.type));
+    return NULL;
 }
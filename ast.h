@@ -19,6 +19,8 @@ struct ASTNode;
 // AST Node structure
 typedef struct ASTNode {
     ASTNodeType type;
+    int line;    // Source position of the node's first token (the operator for binary expressions)
+    int column;
     union {
         struct {
             struct ASTNode **statements;
@@ -55,12 +57,15 @@ typedef struct ASTNode {
 typedef struct {
     TokenArray *tokens;
     int current;
+    int had_error;
+    char error[256];  // First error, reported by the caller once parsing stops
 } Parser;
 
 // AST functions
 ASTNode* ast_node_create(ASTNodeType type);
 void ast_node_free(ASTNode *node);
 void ast_print(ASTNode *node, int indent);
+int ast_count_nodes(ASTNode *node);
 
 // Parser functions
 Parser* parser_create(TokenArray *tokens);
@@ -74,6 +79,7 @@ ASTNode* parse_term(Parser *parser);
 ASTNode* parse_factor(Parser *parser);
 
 // Helper functions
+void parser_error(Parser *parser, const char *format, ...);
 Token parser_current_token(Parser *parser);
 Token parser_consume(Parser *parser, TokenType expected);
 int parser_match(Parser *parser, TokenType type);
@@ -0,0 +1,333 @@
+// Benchmarks every pipeline stage over synthetic programs.
+//
+// Built by `make bench` as ./vemora-bench.
+//
+// Output is one tab-separated line per stage and size after a '#' line
+// describing the configuration, so runs from different commits can be diffed
+// or joined on (stage, size). Times are in milliseconds, throughput is source
+// MB/s of the fastest run.
+#include "generate.h"
+#include "../compiler.h"
+#include "../process.h"
+#include "../token.h"
+#include "../ast.h"
+#include "../cache.h"
+#include "../pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define MAX_SIZES 32
+
+typedef struct {
+    const char *label;
+    size_t size;
+    long statements;
+} Workload;
+
+typedef struct {
+    GeneratorOptions generator;
+    const Backend *backend;
+    int repeat;
+    int jobs;           // Code generation threads
+    ThreadPool *pool;   // Shared by every codegen run, NULL when jobs is 1
+    size_t build_max;   // Largest source that is also compiled end to end
+    size_t run_max;     // Largest source whose executable is also run
+    char output_path[PATH_MAX + 8];
+} Bench;
+
+static double now_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Parse "4096", "64K", "10M" or "1G"
+static size_t parse_size(const char *text) {
+    char *end;
+    double value = strtod(text, &end);
+    switch (*end) {
+        case 'k': case 'K': value *= 1024; break;
+        case 'm': case 'M': value *= 1024 * 1024; break;
+        case 'g': case 'G': value *= 1024 * 1024 * 1024; break;
+    }
+    return (size_t)value;
+}
+
+static void report(const char *stage, const Workload *workload, size_t bytes, long statements,
+                   double *times, int runs) {
+    qsort(times, runs, sizeof(double), compare_doubles);
+    double best = times[0];
+    double median = times[runs / 2];
+    printf("%s\t%s\t%zu\t%ld\t%d\t%.3f\t%.3f\t%.1f\n", stage, workload->label, bytes, statements,
+           runs, best, median, best > 0 ? bytes / (best / 1e3) / 1e6 : 0.0);
+    fflush(stdout);
+}
+
+// Run the produced executable with its output discarded
+static int run_quietly(const char *path) {
+    char *run_argv[] = {(char*)path, NULL};
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    dup2(null_fd, STDOUT_FILENO);
+    close(null_fd);
+
+    int status = process_run(run_argv);
+
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    return status;
+}
+
+static int bench_workload(const Bench *bench, const Workload *workload) {
+    GeneratorOptions generator = bench->generator;
+    generator.size = workload->size;
+    generator.statements = workload->statements;
+
+    size_t bytes;
+    long statements;
+    char *data = generate_program(&generator, &bytes, &statements);
+
+    int runs = bench->repeat;
+    double *times = malloc(sizeof(double) * runs);
+    FILE *null_file = fopen("/dev/null", "w");
+    int status = 0;
+
+    // tokenize
+    TokenArray *tokens = NULL;
+    for (int i = 0; i < runs; i++) {
+        if (tokens) token_array_free(tokens);
+        double start = now_ms();
+        tokens = tokenize(data);
+        times[i] = now_ms() - start;
+    }
+    report("tokenize", workload, bytes, statements, times, runs);
+
+    // parse_program over the same tokens; the AST keeps its own copies of names
+    ASTNode *ast = NULL;
+    for (int i = 0; i < runs; i++) {
+        if (ast) ast_node_free(ast);
+        double start = now_ms();
+        Parser *parser = parser_create(tokens);
+        ast = parse_program(parser);
+        times[i] = now_ms() - start;
+
+        int failed = parser->had_error;
+        if (failed) fprintf(stderr, "Parser error: %s\n", parser->error);
+        parser_free(parser);
+        if (failed) {
+            status = 1;
+            break;
+        }
+    }
+    token_array_free(tokens);
+    if (status == 0) report("parse", workload, bytes, statements, times, runs);
+
+    // codegen_generate into /dev/null
+    for (int i = 0; status == 0 && i < runs; i++) {
+        double start = now_ms();
+        CodeGenerator *codegen = codegen_create(null_file, bench->backend);
+        codegen->pool = bench->pool;
+        int failed = codegen_generate(codegen, ast);
+        times[i] = now_ms() - start;
+
+        if (failed) {
+            fprintf(stderr, "Error: %s\n", codegen->error);
+            status = 1;
+        }
+        codegen_free(codegen);
+    }
+    if (status == 0) report("codegen", workload, bytes, statements, times, runs);
+    ast_node_free(ast);
+
+    // compile_source, including the assembler/C compiler and linker. Limits
+    // apply to the requested size, which the generator overshoots slightly
+    size_t nominal = workload->size ? workload->size : bytes;
+    int built = 0;
+    if (status == 0 && nominal <= bench->build_max) {
+        CompileOptions options = {0};
+        options.backend = bench->backend;
+        options.output_path = bench->output_path;
+        options.comments = true;
+        options.codegen_pool = bench->pool;
+
+        for (int i = 0; i < runs; i++) {
+            CompileResult result;
+            double start = now_ms();
+            int failed = compile_source(data, bytes, &options, &result);
+            times[i] = now_ms() - start;
+
+            if (failed) {
+                fprintf(stderr, "%s\n", result.error);
+                status = 1;
+                break;
+            }
+        }
+        if (status == 0) {
+            report("compile", workload, bytes, statements, times, runs);
+            built = 1;
+        }
+    }
+
+    // The produced binary
+    if (built && nominal <= bench->run_max) {
+        for (int i = 0; i < runs; i++) {
+            double start = now_ms();
+            int exit_status = run_quietly(bench->output_path);
+            times[i] = now_ms() - start;
+
+            if (exit_status != 0) {
+                fprintf(stderr, "Generated program exited with status %d\n", exit_status);
+                status = 1;
+                break;
+            }
+        }
+        if (status == 0) report("run", workload, bytes, statements, times, runs);
+    }
+
+    free(times);
+    free(data);
+    fclose(null_file);
+    return status;
+}
+
+static void print_usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --sizes=LIST        Source sizes, e.g. 1K,64K,10M (default 1K,10K,100K,1M,10M,100M)\n"
+            "  --statements=N      Benchmark a single program of N statements instead\n"
+            "  --depth=N           Expression nesting depth (default 2)\n"
+            "  --width=N           Operands per nesting level (default 3)\n"
+            "  --variables=N       Distinct variable names (default 16)\n"
+            "  --literals=PERCENT  Share of leaves that are literals (default 50)\n"
+            "  --prints=PERCENT    Share of statements that are prints (default 10)\n"
+            "  --seed=N            Generator seed (default 1)\n"
+            "  --repeat=N          Runs per measurement (default 3)\n"
+            "  --emit=asm|c        Backend (default asm)\n"
+            "  --jobs=N            Code generation threads (default 1)\n"
+            "  --build-max=SIZE    Compile end to end up to this size (default 1M)\n"
+            "  --run-max=SIZE      Run executables up to this size (default 1M)\n"
+            "  --generate          Print the program for the first size and exit\n",
+            name);
+}
+
+int main(int argc, char *argv[]) {
+    Bench bench;
+    generator_defaults(&bench.generator);
+    bench.backend = &backend_nasm;
+    bench.repeat = 3;
+    bench.jobs = 1;
+    bench.build_max = 1024 * 1024;
+    bench.run_max = 1024 * 1024;
+
+    const char *sizes = "1K,10K,100K,1M,10M,100M";
+    long statement_count = 0;
+    int generate_only = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--sizes=", 8) == 0) {
+            sizes = argv[i] + 8;
+        } else if (strncmp(argv[i], "--statements=", 13) == 0) {
+            statement_count = atol(argv[i] + 13);
+        } else if (strncmp(argv[i], "--depth=", 8) == 0) {
+            bench.generator.depth = atoi(argv[i] + 8);
+        } else if (strncmp(argv[i], "--width=", 8) == 0) {
+            bench.generator.width = atoi(argv[i] + 8);
+        } else if (strncmp(argv[i], "--variables=", 12) == 0) {
+            bench.generator.variables = atoi(argv[i] + 12);
+        } else if (strncmp(argv[i], "--literals=", 11) == 0) {
+            bench.generator.literal_percent = atoi(argv[i] + 11);
+        } else if (strncmp(argv[i], "--prints=", 9) == 0) {
+            bench.generator.print_percent = atoi(argv[i] + 9);
+        } else if (strncmp(argv[i], "--seed=", 7) == 0) {
+            bench.generator.seed = strtoull(argv[i] + 7, NULL, 10);
+        } else if (strncmp(argv[i], "--repeat=", 9) == 0) {
+            bench.repeat = atoi(argv[i] + 9);
+        } else if (strncmp(argv[i], "--jobs=", 7) == 0) {
+            bench.jobs = thread_pool_clamp_size(atoi(argv[i] + 7));
+        } else if (strncmp(argv[i], "--emit=", 7) == 0) {
+            bench.backend = backend_lookup(argv[i] + 7);
+            if (bench.backend == NULL) {
+                fprintf(stderr, "Unknown backend: %s\n", argv[i] + 7);
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--build-max=", 12) == 0) {
+            bench.build_max = parse_size(argv[i] + 12);
+        } else if (strncmp(argv[i], "--run-max=", 10) == 0) {
+            bench.run_max = parse_size(argv[i] + 10);
+        } else if (strcmp(argv[i], "--generate") == 0) {
+            generate_only = 1;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (bench.repeat < 1) bench.repeat = 1;
+    if (bench.generator.width < 1) bench.generator.width = 1;
+    if (bench.generator.depth < 0) bench.generator.depth = 0;
+
+    Workload workloads[MAX_SIZES];
+    int workload_count = 0;
+    char statements_label[32];
+    char *size_list = strdup(sizes);
+    if (statement_count > 0) {
+        snprintf(statements_label, sizeof(statements_label), "%ldst", statement_count);
+        workloads[workload_count++] = (Workload){statements_label, 0, statement_count};
+    } else {
+        for (char *save, *label = strtok_r(size_list, ",", &save);
+             label && workload_count < MAX_SIZES; label = strtok_r(NULL, ",", &save)) {
+            workloads[workload_count++] = (Workload){label, parse_size(label), 0};
+        }
+    }
+
+    if (generate_only) {
+        GeneratorOptions generator = bench.generator;
+        generator.size = workloads[0].size;
+        generator.statements = workloads[0].statements;
+        size_t length;
+        char *data = generate_program(&generator, &length, NULL);
+        fwrite(data, 1, length, stdout);
+        free(data);
+        free(size_list);
+        return 0;
+    }
+
+    char directory[PATH_MAX];
+    const char *tmpdir = getenv("TMPDIR");
+    snprintf(directory, sizeof(directory), "%s/vemora-bench-XXXXXX", tmpdir && *tmpdir ? tmpdir : "/tmp");
+    if (mkdtemp(directory) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    snprintf(bench.output_path, sizeof(bench.output_path), "%s/output", directory);
+
+    printf("# vemora-bench format=1 version=%s emit=%s depth=%d width=%d variables=%d "
+           "literals=%d prints=%d seed=%llu repeat=%d jobs=%d\n",
+           VEMORA_VERSION, bench.backend->name, bench.generator.depth, bench.generator.width,
+           bench.generator.variables, bench.generator.literal_percent, bench.generator.print_percent,
+           (unsigned long long)bench.generator.seed, bench.repeat, bench.jobs);
+    printf("stage\tsize\tbytes\tstatements\truns\tmin_ms\tmedian_ms\tmb_per_s\n");
+
+    bench.pool = bench.jobs > 1 ? thread_pool_create(bench.jobs) : NULL;
+    int status = 0;
+    for (int i = 0; i < workload_count && status == 0; i++) {
+        status = bench_workload(&bench, &workloads[i]);
+    }
+    if (bench.pool) thread_pool_free(bench.pool);
+
+    unlink(bench.output_path);
+    rmdir(directory);
+    free(size_list);
+    return status;
+}
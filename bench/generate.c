@@ -0,0 +1,100 @@
+#include "generate.h"
+#include "../emitter.h"
+
+typedef struct {
+    Emitter out;
+    const GeneratorOptions *options;
+    uint64_t state;
+    int declared;   // Variables that may be referenced so far
+} Generator;
+
+// xorshift64*: deterministic across platforms and libc versions
+static uint64_t generator_next(Generator *generator) {
+    generator->state ^= generator->state >> 12;
+    generator->state ^= generator->state << 25;
+    generator->state ^= generator->state >> 27;
+    return generator->state * 0x2545F4914F6CDD1DULL;
+}
+
+static int generator_percent(Generator *generator, int percent) {
+    return (int)(generator_next(generator) % 100) < percent;
+}
+
+static void generate_leaf(Generator *generator) {
+    if (generator->declared == 0 || generator_percent(generator, generator->options->literal_percent)) {
+        // The language only has integer literals. Never zero, so divisions stay finite
+        emit_int(&generator->out, 1 + generator_next(generator) % 999);
+        return;
+    }
+
+    emit_char(&generator->out, 'v');
+    emit_int(&generator->out, generator_next(generator) % generator->declared);
+}
+
+static void generate_expression(Generator *generator, int depth) {
+    if (depth == 0) {
+        generate_leaf(generator);
+        return;
+    }
+
+    static const char operators[] = "+-*/";
+    for (int i = 0; i < generator->options->width; i++) {
+        if (i > 0) {
+            emit_char(&generator->out, ' ');
+            emit_char(&generator->out, operators[generator_next(generator) % 4]);
+            emit_char(&generator->out, ' ');
+        }
+        if (depth > 1) emit_char(&generator->out, '(');
+        generate_expression(generator, depth - 1);
+        if (depth > 1) emit_char(&generator->out, ')');
+    }
+}
+
+void generator_defaults(GeneratorOptions *options) {
+    options->size = 0;
+    options->statements = 1000;
+    options->depth = 2;
+    options->width = 3;
+    options->variables = 16;
+    options->literal_percent = 50;
+    options->print_percent = 10;
+    options->seed = 1;
+}
+
+char* generate_program(const GeneratorOptions *options, size_t *length, long *statements) {
+    Generator generator;
+    emitter_init(&generator.out, NULL);
+    generator.options = options;
+    generator.state = options->seed ? options->seed : 1;
+    generator.declared = 0;
+
+    int variables = options->variables > 0 ? options->variables : 1;
+    long count = 0;
+    long declarations = 0;
+    for (;;) {
+        if (options->size ? generator.out.length >= options->size : count >= options->statements) {
+            break;
+        }
+
+        if (generator.declared > 0 && generator_percent(&generator, options->print_percent)) {
+            EMIT_LITERAL(&generator.out, "print(");
+            generate_expression(&generator, options->depth);
+            EMIT_LITERAL(&generator.out, ");\n");
+        } else {
+            // Names cycle, so later declarations redeclare earlier ones
+            int variable = declarations++ % variables;
+            EMIT_LITERAL(&generator.out, "let v");
+            emit_int(&generator.out, variable);
+            EMIT_LITERAL(&generator.out, " = ");
+            generate_expression(&generator, options->depth);
+            EMIT_LITERAL(&generator.out, ";\n");
+            if (generator.declared < variables) generator.declared++;
+        }
+        count++;
+    }
+
+    if (statements) *statements = count;
+    char *source = emitter_take(&generator.out, length);
+    emitter_free(&generator.out);
+    return source;
+}
@@ -0,0 +1,26 @@
+#ifndef GENERATE_H
+#define GENERATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Shape of a synthetic program
+typedef struct {
+    size_t size;          // Stop once the source reaches this many bytes (0: use statements)
+    long statements;      // Stop after this many statements when size is 0
+    int depth;            // Nesting depth of each expression
+    int width;            // Operands per nesting level
+    int variables;        // Distinct variable names that declarations cycle through
+    int literal_percent;  // Share of expression leaves that are literals rather than variables
+    int print_percent;    // Share of statements that are prints rather than declarations
+    uint64_t seed;
+} GeneratorOptions;
+
+// Defaults used by the benchmark harness
+void generator_defaults(GeneratorOptions *options);
+
+// Generate a program. Returns a NUL-terminated malloc'd source and its
+// length and statement count. Equal options always give the same program
+char* generate_program(const GeneratorOptions *options, size_t *length, long *statements);
+
+#endif // GENERATE_H
@@ -0,0 +1,321 @@
+#define _GNU_SOURCE
+#include "cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#define HASH_PRIME 0x9e3779b97f4a7c15ULL
+
+// Temporaries older than this (seconds) belong to a dead process
+#define CACHE_TEMP_MAX_AGE 3600
+
+static uint64_t hash_mix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+// Word-at-a-time hash; only needs to be fast and well distributed, not cryptographic
+static uint64_t hash_bytes(uint64_t hash, const void *data, size_t length) {
+    const unsigned char *bytes = data;
+    hash ^= length * HASH_PRIME;
+
+    while (length >= 8) {
+        uint64_t word;
+        memcpy(&word, bytes, 8);
+        hash = (hash ^ hash_mix(word)) * HASH_PRIME;
+        hash = (hash << 31) | (hash >> 33);
+        bytes += 8;
+        length -= 8;
+    }
+
+    uint64_t tail = 0;
+    memcpy(&tail, bytes, length);
+    hash ^= hash_mix(tail ^ length);
+
+    return hash_mix(hash);
+}
+
+uint64_t cache_key(const char *source, size_t length, const char *flags) {
+    uint64_t hash = hash_bytes(0, VEMORA_VERSION, strlen(VEMORA_VERSION));
+    hash = hash_bytes(hash, flags, strlen(flags));
+    return hash_bytes(hash, source, length);
+}
+
+static int make_directories(const char *path) {
+    char buffer[1024];
+    if (snprintf(buffer, sizeof(buffer), "%s", path) >= (int)sizeof(buffer)) {
+        return -1;
+    }
+
+    for (char *p = buffer + 1; *p; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            if (mkdir(buffer, 0755) != 0 && errno != EEXIST) return -1;
+            *p = '/';
+        }
+    }
+    if (mkdir(buffer, 0755) != 0 && errno != EEXIST) return -1;
+    return 0;
+}
+
+Cache* cache_open(const char *dir, long long max_bytes) {
+    if (make_directories(dir) != 0) {
+        return NULL;
+    }
+
+    Cache *cache = malloc(sizeof(Cache));
+    cache->dir = strdup(dir);
+    cache->max_bytes = max_bytes;
+    return cache;
+}
+
+void cache_free(Cache *cache) {
+    free(cache->dir);
+    free(cache);
+}
+
+static void entry_path(Cache *cache, uint64_t key, const char *extension, char *path, size_t size) {
+    snprintf(path, size, "%s/%016llx.%s", cache->dir, (unsigned long long)key, extension);
+}
+
+// Copy src to dst through a temporary next to dst, so readers never see a partial file
+static int copy_file_atomic(const char *src, const char *dst, mode_t mode) {
+    int in = open(src, O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+        return -1;
+    }
+
+    char temp[1100];
+    snprintf(temp, sizeof(temp), "%s.XXXXXX", dst);
+    int out = mkostemp(temp, O_CLOEXEC);
+    if (out < 0) {
+        close(in);
+        return -1;
+    }
+
+    char buffer[65536];
+    ssize_t n;
+    int result = 0;
+    while ((n = read(in, buffer, sizeof(buffer))) > 0) {
+        if (write(out, buffer, n) != n) {
+            result = -1;
+            break;
+        }
+    }
+    if (n < 0) result = -1;
+
+    close(in);
+    if (fchmod(out, mode) != 0) result = -1;
+    if (close(out) != 0) result = -1;
+
+    if (result == 0 && rename(temp, dst) != 0) result = -1;
+    if (result != 0) unlink(temp);
+    return result;
+}
+
+// Counters are shared by every compiler process using the cache, so they
+// are updated under an exclusive lock
+static void stats_update(Cache *cache, int hit, uint64_t counters[2]) {
+    char path[1100];
+    snprintf(path, sizeof(path), "%s/stats", cache->dir);
+
+    counters[0] = counters[1] = 0;
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return;
+    }
+
+    flock(fd, LOCK_EX);
+    if (pread(fd, counters, sizeof(uint64_t) * 2, 0) != sizeof(uint64_t) * 2) {
+        counters[0] = counters[1] = 0;
+    }
+    if (hit >= 0) {
+        counters[hit ? 0 : 1]++;
+        if (pwrite(fd, counters, sizeof(uint64_t) * 2, 0) != sizeof(uint64_t) * 2) {
+            fprintf(stderr, "Warning: could not update cache stats\n");
+        }
+    }
+    flock(fd, LOCK_UN);
+    close(fd);
+}
+
+int cache_lookup(Cache *cache, uint64_t key, const char *output_path, const char *source_path) {
+    char exe_path[1100];
+    char src_path[1100];
+    entry_path(cache, key, "exe", exe_path, sizeof(exe_path));
+    entry_path(cache, key, "src", src_path, sizeof(src_path));
+
+    uint64_t counters[2];
+    int hit = access(exe_path, R_OK) == 0 &&
+              (source_path == NULL || access(src_path, R_OK) == 0) &&
+              copy_file_atomic(exe_path, output_path, 0755) == 0 &&
+              (source_path == NULL || copy_file_atomic(src_path, source_path, 0644) == 0);
+
+    if (hit) {
+        // Refresh recency for LRU eviction
+        utimensat(AT_FDCWD, exe_path, NULL, 0);
+        if (source_path) utimensat(AT_FDCWD, src_path, NULL, 0);
+    }
+
+    stats_update(cache, hit, counters);
+    return hit;
+}
+
+// An entry is the <key>.exe and <key>.src pair, evicted together
+typedef struct {
+    char name[32];             // Key part of the file names
+    long long size;            // Both files
+    struct timespec mtime;     // Most recent of the two
+} CacheEntry;
+
+static int cache_entry_compare(const void *a, const void *b) {
+    const CacheEntry *x = a;
+    const CacheEntry *y = b;
+    if (x->mtime.tv_sec != y->mtime.tv_sec) return x->mtime.tv_sec < y->mtime.tv_sec ? -1 : 1;
+    if (x->mtime.tv_nsec != y->mtime.tv_nsec) return x->mtime.tv_nsec < y->mtime.tv_nsec ? -1 : 1;
+    return 0;
+}
+
+static int cache_entry_name_compare(const void *a, const void *b) {
+    return strcmp(((const CacheEntry *)a)->name, ((const CacheEntry *)b)->name);
+}
+
+// "<16 hex digits>.exe" or ".src", as written by entry_path
+#define ENTRY_NAME_LENGTH 20
+
+static int is_entry_name(const char *name, size_t length) {
+    return length == ENTRY_NAME_LENGTH && strspn(name, "0123456789abcdef") == 16 &&
+           (strncmp(name + 16, ".exe", 4) == 0 || strncmp(name + 16, ".src", 4) == 0);
+}
+
+// "<entry>.XXXXXX", left behind when a process dies inside copy_file_atomic
+static int is_temp_name(const char *name) {
+    size_t length = strlen(name);
+    return length == ENTRY_NAME_LENGTH + 7 && name[ENTRY_NAME_LENGTH] == '.' &&
+           is_entry_name(name, ENTRY_NAME_LENGTH);
+}
+
+// Collect all entries; returns the count and stores the array in *entries.
+// Temporaries older than CACHE_TEMP_MAX_AGE are deleted along the way
+static int cache_scan(Cache *cache, CacheEntry **entries, long long *total) {
+    *entries = NULL;
+    *total = 0;
+
+    DIR *dir = opendir(cache->dir);
+    if (dir == NULL) {
+        return 0;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    int count = 0;
+    int capacity = 0;
+    struct dirent *dirent;
+    while ((dirent = readdir(dir)) != NULL) {
+        const char *name = dirent->d_name;
+        int temp = is_temp_name(name);
+        if (!temp && !is_entry_name(name, strlen(name))) continue;
+
+        struct stat st;
+        if (fstatat(dirfd(dir), name, &st, 0) != 0) continue;
+
+        if (temp) {
+            if (now.tv_sec - st.st_mtim.tv_sec > CACHE_TEMP_MAX_AGE) {
+                unlinkat(dirfd(dir), name, 0);
+            }
+            continue;
+        }
+
+        if (count >= capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            *entries = realloc(*entries, sizeof(CacheEntry) * capacity);
+        }
+        CacheEntry *entry = &(*entries)[count++];
+        snprintf(entry->name, sizeof(entry->name), "%.16s", name);
+        entry->size = st.st_size;
+        entry->mtime = st.st_mtim;
+        *total += st.st_size;
+    }
+    closedir(dir);
+
+    // Merge the .exe and .src of each key into one entry
+    qsort(*entries, count, sizeof(CacheEntry), cache_entry_name_compare);
+    int merged = 0;
+    for (int i = 0; i < count; i++) {
+        CacheEntry *entry = &(*entries)[i];
+        CacheEntry *last = merged ? &(*entries)[merged - 1] : NULL;
+        if (last && strcmp(last->name, entry->name) == 0) {
+            last->size += entry->size;
+            if (cache_entry_compare(entry, last) > 0) last->mtime = entry->mtime;
+        } else {
+            (*entries)[merged++] = *entry;
+        }
+    }
+    return merged;
+}
+
+static void cache_evict(Cache *cache) {
+    CacheEntry *entries;
+    long long total;
+    int count = cache_scan(cache, &entries, &total);
+
+    if (total > cache->max_bytes) {
+        qsort(entries, count, sizeof(CacheEntry), cache_entry_compare);
+        for (int i = 0; i < count && total > cache->max_bytes; i++) {
+            // The executable goes first: without it the entry is already a miss
+            const char *extensions[] = {"exe", "src"};
+            for (int e = 0; e < 2; e++) {
+                char path[1400];
+                snprintf(path, sizeof(path), "%s/%s.%s", cache->dir, entries[i].name, extensions[e]);
+                // Another process may have evicted it already
+                unlink(path);
+            }
+            total -= entries[i].size;
+        }
+    }
+
+    free(entries);
+}
+
+void cache_store(Cache *cache, uint64_t key, const char *output_path, const char *source_path) {
+    char path[1100];
+
+    if (source_path) {
+        entry_path(cache, key, "src", path, sizeof(path));
+        copy_file_atomic(source_path, path, 0644);
+    }
+
+    // The executable goes in last: its presence is what makes an entry a hit
+    entry_path(cache, key, "exe", path, sizeof(path));
+    if (copy_file_atomic(output_path, path, 0755) != 0) {
+        fprintf(stderr, "Warning: could not store %s in cache\n", output_path);
+    }
+
+    cache_evict(cache);
+}
+
+void cache_print_stats(Cache *cache) {
+    uint64_t counters[2];
+    stats_update(cache, -1, counters);
+
+    CacheEntry *entries;
+    long long total;
+    int count = cache_scan(cache, &entries, &total);
+    free(entries);
+
+    printf("Cache %s: %llu hits, %llu misses, %d entries, %lld / %lld bytes\n",
+           cache->dir, (unsigned long long)counters[0], (unsigned long long)counters[1],
+           count, total, cache->max_bytes);
+}
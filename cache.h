@@ -0,0 +1,38 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Bumped whenever generated code may change, so stale cache entries are never reused
+#define VEMORA_VERSION "0.2.0"
+
+#define CACHE_DEFAULT_MAX_BYTES (256LL * 1024 * 1024)
+
+// Content-addressed store of compiled executables (and optionally their
+// generated source), keyed by source bytes, compiler version and codegen flags.
+// Entries live in <dir>/<key>.exe and <dir>/<key>.src; hit/miss counters in <dir>/stats
+typedef struct {
+    char *dir;
+    long long max_bytes;
+} Cache;
+
+// Open (creating if needed) a cache directory. Returns NULL on failure
+Cache* cache_open(const char *dir, long long max_bytes);
+void cache_free(Cache *cache);
+
+// Hash the source together with everything else that affects the output
+uint64_t cache_key(const char *source, size_t length, const char *flags);
+
+// On a hit copy the executable to output_path (and the generated source to
+// source_path, if given) and return 1. Returns 0 on a miss
+int cache_lookup(Cache *cache, uint64_t key, const char *output_path, const char *source_path);
+
+// Atomically insert a freshly built executable (and source, if given), then evict
+// least recently used entries until the cache fits in max_bytes
+void cache_store(Cache *cache, uint64_t key, const char *output_path, const char *source_path);
+
+// Print hit/miss counters and current size
+void cache_print_stats(Cache *cache);
+
+#endif // CACHE_H
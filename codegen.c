@@ -1,30 +1,67 @@
 #include "codegen.h"
+#include "process.h"
+#include "pool.h"
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <stdarg.h>
 
-CodeGenerator* codegen_create(FILE *output) {
-    CodeGenerator *codegen = malloc(sizeof(CodeGenerator));
+CodeGenerator* codegen_create(FILE *output, const Backend *backend) {
+    CodeGenerator *codegen = stats_malloc(sizeof(CodeGenerator));
     codegen->output = output;
+    emitter_init(&codegen->out, output);
+    codegen->comments = 1;
+    codegen->profile = 0;
+    codegen->profile_count = 0;
+    codegen->profile_lines = NULL;
+    codegen->profile_path = PROFILE_FILE;
+    codegen->profile_script = NULL;
+    codegen->script_path = NULL;
+    codegen->output_name = "<stdin>";
+    codegen->pool = NULL;
+    codegen->jobs = 1;
+    codegen->owns_pool = 0;
+    codegen->backend = backend;
     codegen->symbol_table = symbol_table_create();
-    codegen->label_counter = 0;
+    codegen->instruction_count = 0;
+    codegen->had_error = 0;
+    codegen->error[0] = '\0';
     return codegen;
 }
 
 void codegen_free(CodeGenerator *codegen) {
+    emitter_free(&codegen->out);
     symbol_table_free(codegen->symbol_table);
+    free(codegen->profile_lines);
+    if (codegen->owns_pool) thread_pool_free(codegen->pool);
     free(codegen);
 }
 
 SymbolTable* symbol_table_create() {
-    SymbolTable *table = malloc(sizeof(SymbolTable));
-    table->symbols = malloc(sizeof(Symbol) * 10);
+    SymbolTable *table = stats_malloc(sizeof(SymbolTable));
+    table->symbols = stats_malloc(sizeof(Symbol) * 10);
     table->count = 0;
     table->capacity = 10;
     table->current_offset = 0;
+    table->borrowed = 0;
     return table;
 }
 
+SymbolTable* symbol_table_view(SymbolTable *table, int count) {
+    SymbolTable *view = stats_malloc(sizeof(SymbolTable));
+    view->symbols = table->symbols;
+    view->count = count;
+    view->capacity = table->capacity;
+    view->current_offset = count > 0 ? table->symbols[count - 1].stack_offset : 0;
+    view->borrowed = 1;
+    return view;
+}
+
 void symbol_table_free(SymbolTable *table) {
+    if (table->borrowed) {
+        free(table);
+        return;
+    }
     for (int i = 0; i < table->count; i++) {
         free(table->symbols[i].name);
     }
@@ -35,9 +72,9 @@ void symbol_table_free(SymbolTable *table) {
 void symbol_table_add(SymbolTable *table, const char *name, int offset) {
     if (table->count >= table->capacity) {
         table->capacity *= 2;
-        table->symbols = realloc(table->symbols, sizeof(Symbol) * table->capacity);
+        table->symbols = stats_realloc(table->symbols, sizeof(Symbol) * table->capacity);
     }
-    table->symbols[table->count].name = strdup(name);
+    table->symbols[table->count].name = stats_strdup(name);
     table->symbols[table->count].stack_offset = offset;
     table->count++;
 }
@@ -51,70 +88,502 @@ Symbol* symbol_table_lookup(SymbolTable *table, const char *name) {
     return NULL;
 }
 
+const Backend* backend_lookup(const char *name) {
+    if (strcmp(name, "asm") == 0) return &backend_nasm;
+    if (strcmp(name, "c") == 0) return &backend_c;
+    return NULL;
+}
+
+// Lower statement `index` with everything that surrounds it
+static void codegen_emit_statement(CodeGenerator *codegen, ASTNode *statement, int index) {
+    const Backend *backend = codegen->backend;
+    if (codegen->script_path) backend->line_directive(codegen, statement->line);
+    if (codegen->profile) backend->profile_enter(codegen, index);
+    backend->statement(codegen, statement);
+    if (codegen->profile) backend->profile_exit(codegen, index);
+}
+
+// Smallest run of statements worth handing to a worker
+#define CODEGEN_CHUNK_MIN 1024
+// Largest run, so huge programs split into many chunks and only a few are buffered at once
+#define CODEGEN_CHUNK_MAX 4096
+// Chunks queued or buffered per worker, ahead of the one being written out
+#define CODEGEN_CHUNKS_IN_FLIGHT 2
+
+// Signalled by workers as chunks finish
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t finished;
+} CodegenJoin;
+
+// A run of consecutive statements lowered on one worker
+typedef struct {
+    CodeGenerator *parent;
+    CodegenJoin *join;
+    ASTNode **statements;
+    int first;          // Index of statements[0] in the program
+    int count;
+    int symbol_count;   // Symbols declared before the first statement
+    CodeGenerator *codegen;
+    int done;           // Set under join->lock once codegen holds the output
+} CodegenChunk;
+
+static void codegen_chunk_run(void *arg) {
+    CodegenChunk *chunk = arg;
+    CodeGenerator *parent = chunk->parent;
+
+    // Same settings as the parent, but private output, counters and symbol view
+    CodeGenerator *codegen = codegen_create(NULL, parent->backend);
+    symbol_table_free(codegen->symbol_table);
+    codegen->symbol_table = symbol_table_view(parent->symbol_table, chunk->symbol_count);
+    codegen->comments = parent->comments;
+    codegen->profile = parent->profile;
+    codegen->profile_count = parent->profile_count;
+    codegen->script_path = parent->script_path;
+
+    for (int i = 0; i < chunk->count && !codegen->had_error; i++) {
+        codegen_emit_statement(codegen, chunk->statements[i], chunk->first + i);
+    }
+
+    pthread_mutex_lock(&chunk->join->lock);
+    chunk->codegen = codegen;
+    chunk->done = 1;
+    pthread_cond_broadcast(&chunk->join->finished);
+    pthread_mutex_unlock(&chunk->join->lock);
+}
+
+// Two phases: a serial pass gives every declaration its slot (the same one
+// codegen_declare would) and notes where each chunk starts, then chunks are
+// lowered on a pool, each resolving identifiers against the prefix of the
+// table it would have seen serially. Each chunk is written out as soon as it
+// and all before it are done, and only a few chunks per worker are in flight,
+// so memory stays bounded and the output streams like the serial loop's, to
+// which it is byte-identical
+static void codegen_generate_parallel(CodeGenerator *codegen, ASTNode *ast) {
+    int statement_count = ast->data.program.statement_count;
+    ASTNode **statements = ast->data.program.statements;
+
+    // About four chunks per worker, each CODEGEN_CHUNK_MIN..CODEGEN_CHUNK_MAX statements.
+    // Compare before multiplying so a large job count cannot overflow
+    int worker_count = codegen->pool->worker_count;
+    int chunk_count = statement_count / CODEGEN_CHUNK_MIN;
+    if (worker_count < chunk_count / 4) {
+        chunk_count = worker_count * 4;
+    }
+    if (chunk_count < statement_count / CODEGEN_CHUNK_MAX) {
+        chunk_count = statement_count / CODEGEN_CHUNK_MAX;
+    }
+    int chunk_size = (statement_count + chunk_count - 1) / chunk_count;
+    CodegenChunk *chunks = stats_calloc(chunk_count, sizeof(CodegenChunk));
+
+    CodegenJoin join;
+    pthread_mutex_init(&join.lock, NULL);
+    pthread_cond_init(&join.finished, NULL);
+
+    for (int c = 0; c < chunk_count; c++) {
+        CodegenChunk *chunk = &chunks[c];
+        chunk->parent = codegen;
+        chunk->join = &join;
+        chunk->first = c * chunk_size;
+        chunk->count = statement_count - chunk->first < chunk_size ? statement_count - chunk->first : chunk_size;
+        if (chunk->count < 0) chunk->count = 0;
+        chunk->statements = statements + chunk->first;
+        chunk->symbol_count = codegen->symbol_table->count;
+
+        for (int i = 0; i < chunk->count; i++) {
+            ASTNode *statement = chunk->statements[i];
+            if (statement->type == AST_VARIABLE_DECLARATION) {
+                codegen_declare(codegen, statement->data.variable_declaration.name);
+            }
+        }
+    }
+
+    // Workers only read the table from here on
+    int in_flight = worker_count > chunk_count / CODEGEN_CHUNKS_IN_FLIGHT ? chunk_count : worker_count * CODEGEN_CHUNKS_IN_FLIGHT;
+    int submitted = 0;
+    while (submitted < in_flight) {
+        thread_pool_submit(codegen->pool, codegen_chunk_run, &chunks[submitted++]);
+    }
+
+    // Join in order, topping the window up as each chunk leaves it. The serial
+    // loop stops at the first failing statement; so does the join
+    for (int c = 0; c < submitted; c++) {
+        pthread_mutex_lock(&join.lock);
+        while (!chunks[c].done) {
+            pthread_cond_wait(&join.finished, &join.lock);
+        }
+        pthread_mutex_unlock(&join.lock);
+
+        CodeGenerator *part = chunks[c].codegen;
+        if (!codegen->had_error) {
+            emitter_append(&codegen->out, part->out.data, part->out.length);
+            codegen->instruction_count += part->instruction_count;
+            if (part->had_error) {
+                codegen_error(codegen, "%s", part->error);
+            }
+        }
+        codegen_free(part);
+
+        if (!codegen->had_error && submitted < chunk_count) {
+            thread_pool_submit(codegen->pool, codegen_chunk_run, &chunks[submitted++]);
+        }
+    }
+
+    // Workers may still be inside the final unlock
+    thread_pool_wait(codegen->pool);
+    pthread_cond_destroy(&join.finished);
+    pthread_mutex_destroy(&join.lock);
+    free(chunks);
+}
+
+int codegen_generate(CodeGenerator *codegen, ASTNode *ast) {
+    const Backend *backend = codegen->backend;
+    int statement_count = ast->data.program.statement_count;
+
+    if (codegen->profile) {
+        codegen->profile_count = statement_count;
+        codegen->profile_lines = stats_malloc(sizeof(int) * (statement_count > 0 ? statement_count : 1));
+        for (int i = 0; i < statement_count; i++) {
+            codegen->profile_lines[i] = ast->data.program.statements[i]->line;
+        }
+    }
+
+    backend->prologue(codegen);
+    // Small scripts never pay for starting threads
+    if (codegen->pool == NULL && codegen->jobs > 1 && statement_count >= 2 * CODEGEN_CHUNK_MIN) {
+        codegen->pool = thread_pool_create(codegen->jobs);
+        codegen->owns_pool = 1;
+    }
+    if (codegen->pool && codegen->pool->worker_count > 1 && statement_count >= 2 * CODEGEN_CHUNK_MIN) {
+        codegen_generate_parallel(codegen, ast);
+    } else {
+        for (int i = 0; i < statement_count && !codegen->had_error; i++) {
+            codegen_emit_statement(codegen, ast->data.program.statements[i], i);
+        }
+    }
+    // Exit code and profile tables are not part of the last statement
+    if (codegen->script_path) backend->line_directive(codegen, 0);
+    backend->epilogue(codegen);
+
+    if (emitter_flush(&codegen->out) != 0) {
+        codegen_error(codegen, "Could not write generated code");
+    }
+    return codegen->had_error;
+}
+
+int codegen_declare(CodeGenerator *codegen, const char *name) {
+    // Every declaration gets a fresh 8-byte slot, even when the name repeats
+    SymbolTable *table = codegen->symbol_table;
+    table->current_offset += 8;
+    if (table->borrowed) {
+        // Already assigned up front; just make it visible
+        table->count++;
+    } else {
+        symbol_table_add(table, name, table->current_offset);
+    }
+    return table->current_offset;
+}
+
+void codegen_error(CodeGenerator *codegen, const char *format, ...) {
+    if (codegen->had_error) return;
+    codegen->had_error = 1;
+
+    va_list args;
+    va_start(args, format);
+    vsnprintf(codegen->error, sizeof(codegen->error), format, args);
+    va_end(args);
+}
+
+void build_error(BuildJob *job, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    vsnprintf(job->error, sizeof(job->error), format, args);
+    va_end(args);
+}
+
 void codegen_expression(CodeGenerator *codegen, ASTNode *node);
-void codegen_statement(CodeGenerator *codegen, ASTNode *node);
-
-void codegen_generate(CodeGenerator *codegen, ASTNode *ast) {
-    fprintf(codegen->output, "section .data\n");
-    fprintf(codegen->output, "    newline db 10, 0\n");
-    fprintf(codegen->output, "    output_buffer db '                    ', 0  ; Buffer for number conversion\n");
-    
-    fprintf(codegen->output, "\nsection .text\n");
-    fprintf(codegen->output, "    global _start\n\n");
-    
-    // Helper function to print a floating point number
-    fprintf(codegen->output, "print_float:\n");
-    fprintf(codegen->output, "    ; Simple float printing (prints integer part only for now)\n");
-    fprintf(codegen->output, "    cvttsd2si rax, xmm0     ; Convert float to integer\n");
-    fprintf(codegen->output, "    \n");
-    fprintf(codegen->output, "    ; Convert integer to string\n");
-    fprintf(codegen->output, "    mov rdi, output_buffer + 19  ; Point to end of buffer\n");
-    fprintf(codegen->output, "    mov byte [rdi], 0       ; Null terminate\n");
-    fprintf(codegen->output, "    dec rdi\n");
-    fprintf(codegen->output, "    mov rbx, 10\n");
-    fprintf(codegen->output, "    \n");
-    fprintf(codegen->output, "convert_loop:\n");
-    fprintf(codegen->output, "    xor rdx, rdx\n");
-    fprintf(codegen->output, "    div rbx\n");
-    fprintf(codegen->output, "    add dl, '0'\n");
-    fprintf(codegen->output, "    mov [rdi], dl\n");
-    fprintf(codegen->output, "    dec rdi\n");
-    fprintf(codegen->output, "    test rax, rax\n");
-    fprintf(codegen->output, "    jnz convert_loop\n");
-    fprintf(codegen->output, "    \n");
-    fprintf(codegen->output, "    ; Print the string\n");
-    fprintf(codegen->output, "    inc rdi                 ; Point to first digit\n");
-    fprintf(codegen->output, "    mov rax, 1              ; sys_write\n");
-    fprintf(codegen->output, "    mov rsi, rdi            ; String to print\n");
-    fprintf(codegen->output, "    mov rdi, 1              ; stdout\n");
-    fprintf(codegen->output, "    mov rdx, output_buffer + 20\n");
-    fprintf(codegen->output, "    sub rdx, rsi            ; Calculate length\n");
-    fprintf(codegen->output, "    syscall\n");
-    fprintf(codegen->output, "    \n");
-    fprintf(codegen->output, "    ; Print newline\n"); 
-    fprintf(codegen->output, "    mov rax, 1              ; sys_write\n");
-    fprintf(codegen->output, "    mov rdi, 1              ; stdout\n");
-    fprintf(codegen->output, "    mov rsi, newline        ; newline character\n");
-    fprintf(codegen->output, "    mov rdx, 1              ; length\n");
-    fprintf(codegen->output, "    syscall\n");
-    fprintf(codegen->output, "    ret\n\n");
-    
-    fprintf(codegen->output, "_start:\n");
-    fprintf(codegen->output, "    push rbp\n");
-    fprintf(codegen->output, "    mov rbp, rsp\n");
-    fprintf(codegen->output, "    sub rsp, 256    ; Reserve stack space for variables\n\n");
-    
-    // Generate code for all statements
-    for (int i = 0; i < ast->data.program.statement_count; i++) {
-        codegen_statement(codegen, ast->data.program.statements[i]);
-    }
-    
-    fprintf(codegen->output, "\n    ; Exit program\n");
-    fprintf(codegen->output, "    mov rax, 60     ; sys_exit\n");
-    fprintf(codegen->output, "    mov rdi, 0      ; exit status\n");
-    fprintf(codegen->output, "    syscall\n");
+
+static void codegen_comment(CodeGenerator *codegen, const char *text) {
+    if (codegen->comments) {
+        emit_string(&codegen->out, text);
+    }
+}
+
+// NASM re-reads its input on every pass, so the assembly is written to a file
+// (a private temporary unless the caller wants to keep it) instead of a pipe
+static int nasm_build_begin(BuildJob *job) {
+    job->pid = -1;
+    job->temp_source[0] = '\0';
+    job->temp_object[0] = '\0';
+
+    if (job->source_path) {
+        job->stream = fopen(job->source_path, "we");
+    } else {
+        job->stream = temp_file_create(job->temp_source, sizeof(job->temp_source));
+    }
+    if (job->stream == NULL) {
+        build_error(job, "Error creating assembly file");
+        return 1;
+    }
+    return 0;
+}
+
+static int nasm_build_finish(BuildJob *job) {
+    int result = 0;
+    const char *source = job->source_path ? job->source_path : job->temp_source;
+
+    if (fclose(job->stream) != 0) {
+        build_error(job, "Error writing assembly file");
+        result = 1;
+    }
+
+    FILE *object = NULL;
+    if (result == 0) {
+        object = temp_file_create(job->temp_object, sizeof(job->temp_object));
+        if (object == NULL) {
+            build_error(job, "Error creating object file");
+            result = 1;
+        } else {
+            fclose(object);
+        }
+    }
+
+    StatsTimer timer;
+    if (result == 0) {
+        char *nasm_argv[] = {"nasm", "-f", "elf64", (char*)source, "-o", job->temp_object, NULL, NULL, NULL};
+        if (job->debug_info) {
+            // DWARF line info follows the %line directives back to the script
+            nasm_argv[6] = "-g";
+            nasm_argv[7] = "-Fdwarf";
+        }
+        stats_start(job->stats, &timer);
+        if (process_run(nasm_argv) != 0) {
+            build_error(job, "Error running nasm command");
+            result = 1;
+        }
+        stats_stop(job->stats, PHASE_ASSEMBLE, &timer);
+    }
+
+    if (result == 0) {
+        char *ld_argv[] = {"ld", job->temp_object, "-o", (char*)job->output_path, NULL};
+        stats_start(job->stats, &timer);
+        if (process_run(ld_argv) != 0) {
+            build_error(job, "Error running ld command");
+            result = 1;
+        }
+        stats_stop(job->stats, PHASE_LINK, &timer);
+    }
+
+    if (job->temp_source[0]) unlink(job->temp_source);
+    if (job->temp_object[0]) unlink(job->temp_object);
+    return result;
+}
+
+static void nasm_build_abort(BuildJob *job) {
+    fclose(job->stream);
+    if (job->temp_source[0]) unlink(job->temp_source);
 }
 
+static void nasm_prologue(CodeGenerator *codegen) {
+    // Data section, print_float helper and the entry point, emitted as one block
+    codegen->instruction_count += 28;
+    EMIT_LITERAL(&codegen->out,
+        "section .data\n"
+        "    newline db 10, 0\n"
+        "    output_buffer db '                    ', 0  ; Buffer for number conversion\n"
+        "\nsection .text\n"
+        "    global _start\n\n"
+        "print_float:\n"
+        "    ; Simple float printing (prints integer part only for now)\n"
+        "    cvttsd2si rax, xmm0     ; Convert float to integer\n"
+        "    \n"
+        "    ; Convert integer to string\n"
+        "    mov rdi, output_buffer + 19  ; Point to end of buffer\n"
+        "    mov byte [rdi], 0       ; Null terminate\n"
+        "    dec rdi\n"
+        "    mov rbx, 10\n"
+        "    \n"
+        "convert_loop:\n"
+        "    xor rdx, rdx\n"
+        "    div rbx\n"
+        "    add dl, '0'\n"
+        "    mov [rdi], dl\n"
+        "    dec rdi\n"
+        "    test rax, rax\n"
+        "    jnz convert_loop\n"
+        "    \n"
+        "    ; Print the string\n"
+        "    inc rdi                 ; Point to first digit\n"
+        "    mov rax, 1              ; sys_write\n"
+        "    mov rsi, rdi            ; String to print\n"
+        "    mov rdi, 1              ; stdout\n"
+        "    mov rdx, output_buffer + 20\n"
+        "    sub rdx, rsi            ; Calculate length\n"
+        "    syscall\n"
+        "    \n"
+        "    ; Print newline\n"
+        "    mov rax, 1              ; sys_write\n"
+        "    mov rdi, 1              ; stdout\n"
+        "    mov rsi, newline        ; newline character\n"
+        "    mov rdx, 1              ; length\n"
+        "    syscall\n"
+        "    ret\n\n"
+        "_start:\n"
+        "    push rbp\n"
+        "    mov rbp, rsp\n"
+        "    sub rsp, 256    ; Reserve stack space for variables\n\n");
+}
+
+// Everything up to the next directive maps to `line` (the +0 stops NASM from
+// counting its own lines on from there). Line 0 is DWARF's "no source line"
+static void nasm_line_directive(CodeGenerator *codegen, int line) {
+    EMIT_LITERAL(&codegen->out, "%line ");
+    emit_int(&codegen->out, line);
+    EMIT_LITERAL(&codegen->out, "+0 ");
+    emit_string(&codegen->out, codegen->script_path);
+    emit_char(&codegen->out, '\n');
+}
+
+// Timestamps are taken after lfence so earlier instructions have retired
+static void nasm_profile_enter(CodeGenerator *codegen, int index) {
+    (void)index;
+    codegen->instruction_count += 5;
+    EMIT_LITERAL(&codegen->out,
+        "    lfence\n"
+        "    rdtsc\n"
+        "    shl rdx, 32\n"
+        "    or rax, rdx\n"
+        "    mov [profile_start], rax\n");
+}
+
+static void nasm_profile_exit(CodeGenerator *codegen, int index) {
+    codegen->instruction_count += 7;
+    EMIT_LITERAL(&codegen->out,
+        "    lfence\n"
+        "    rdtsc\n"
+        "    shl rdx, 32\n"
+        "    or rax, rdx\n"
+        "    sub rax, [profile_start]\n"
+        "    add [profile_counters+");
+    emit_int(&codegen->out, index * 16);
+    EMIT_LITERAL(&codegen->out, "], rax\n    inc qword [profile_counters+");
+    emit_int(&codegen->out, index * 16 + 8);
+    EMIT_LITERAL(&codegen->out, "]\n\n");
+}
+
+// Dump the header and counters to profile_path with raw syscalls
+static void nasm_profile_write(CodeGenerator *codegen) {
+    codegen->instruction_count += 21;
+    EMIT_LITERAL(&codegen->out,
+        "\n    ; Write the profile\n"
+        "    mov rax, 2      ; sys_open\n"
+        "    mov rdi, profile_path\n"
+        "    mov rsi, 0x241  ; O_WRONLY | O_CREAT | O_TRUNC\n"
+        "    mov rdx, 420    ; 0644\n"
+        "    syscall\n"
+        "    test rax, rax\n"
+        "    js profile_done\n"
+        "    mov r12, rax\n"
+        "    mov rax, 1      ; sys_write\n"
+        "    mov rdi, r12\n"
+        "    mov rsi, profile_header\n"
+        "    mov rdx, profile_header_size\n"
+        "    syscall\n"
+        "    mov rax, 1      ; sys_write\n"
+        "    mov rdi, r12\n"
+        "    mov rsi, profile_counters\n"
+        "    mov rdx, ");
+    emit_int(&codegen->out, (long long)codegen->profile_count * 16);
+    EMIT_LITERAL(&codegen->out,
+        "\n    syscall\n"
+        "    mov rax, 3      ; sys_close\n"
+        "    mov rdi, r12\n"
+        "    syscall\n"
+        "profile_done:\n");
+}
+
+// Emit `values` as directive lines (db, dq) of up to 16 numbers each
+static void nasm_emit_numbers(Emitter *out, const char *directive, const long long *values, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (i % 16 == 0) {
+            EMIT_LITERAL(out, "    ");
+            emit_string(out, directive);
+            emit_char(out, ' ');
+        } else {
+            emit_char(out, ',');
+        }
+        emit_int(out, values[i]);
+        if (i % 16 == 15 || i + 1 == count) emit_char(out, '\n');
+    }
+}
+
+// The header is fixed at build time, so it lives in .data and goes out in one write
+static void nasm_profile_data(CodeGenerator *codegen) {
+    const char *script = codegen->profile_script ? codegen->profile_script : "";
+    size_t script_length = strlen(script);
+    size_t path_length = strlen(codegen->profile_path);
+    size_t count = codegen->profile_count;
+    size_t largest = script_length > count ? script_length : count;
+    long long *values = stats_malloc(sizeof(long long) * ((largest > path_length ? largest : path_length) + 1));
+
+    // Numeric bytes, since a path may contain anything a NASM string can't
+    EMIT_LITERAL(&codegen->out, "\nsection .data\nprofile_path:\n");
+    for (size_t i = 0; i <= path_length; i++) values[i] = (unsigned char)codegen->profile_path[i];
+    nasm_emit_numbers(&codegen->out, "db", values, path_length + 1);
+    EMIT_LITERAL(&codegen->out,
+        "    align 8, db 0\n"
+        "profile_header:\n"
+        "    db \"VMPROF2\", 10\n"
+        "    dq ");
+    emit_int(&codegen->out, codegen->profile_count);
+    EMIT_LITERAL(&codegen->out, "\n    dq ");
+    emit_int(&codegen->out, script_length);
+    emit_char(&codegen->out, '\n');
+
+    for (size_t i = 0; i < script_length; i++) values[i] = (unsigned char)script[i];
+    nasm_emit_numbers(&codegen->out, "db", values, script_length);
+    EMIT_LITERAL(&codegen->out, "    align 8, db 0\n");
+    for (size_t i = 0; i < count; i++) values[i] = codegen->profile_lines[i];
+    nasm_emit_numbers(&codegen->out, "dq", values, count);
+    free(values);
+
+    EMIT_LITERAL(&codegen->out,
+        "    profile_header_size equ $ - profile_header\n"
+        "\nsection .bss\n"
+        "    alignb 8\n"
+        "    profile_start resq 1\n"
+        "    profile_counters resq ");
+    emit_int(&codegen->out, (long long)codegen->profile_count * 2);
+    emit_char(&codegen->out, '\n');
+}
+
+static void nasm_epilogue(CodeGenerator *codegen) {
+    if (codegen->profile) nasm_profile_write(codegen);
+
+    codegen->instruction_count += 3;
+    EMIT_LITERAL(&codegen->out,
+        "\n    ; Exit program\n"
+        "    mov rax, 60     ; sys_exit\n"
+        "    mov rdi, 0      ; exit status\n"
+        "    syscall\n");
+
+    if (codegen->profile) nasm_profile_data(codegen);
+}
+
+const Backend backend_nasm = {
+    .name = "asm",
+    .source_extension = "asm",
+    .prologue = nasm_prologue,
+    .statement = codegen_statement,
+    .epilogue = nasm_epilogue,
+    .build_begin = nasm_build_begin,
+    .build_finish = nasm_build_finish,
+    .build_abort = nasm_build_abort,
+    .line_directive = nasm_line_directive,
+    .profile_enter = nasm_profile_enter,
+    .profile_exit = nasm_profile_exit,
+};
+
 void codegen_statement(CodeGenerator *codegen, ASTNode *node) {
     switch (node->type) {
         case AST_VARIABLE_DECLARATION: {
@@ -122,42 +591,45 @@ void codegen_statement(CodeGenerator *codegen, ASTNode *node) {
             codegen_expression(codegen, node->data.variable_declaration.value);
             
             // Allocate stack space for variable
-            codegen->symbol_table->current_offset += 8;
-            symbol_table_add(codegen->symbol_table, 
-                           node->data.variable_declaration.name, 
-                           codegen->symbol_table->current_offset);
+            int offset = codegen_declare(codegen, node->data.variable_declaration.name);
             
-            fprintf(codegen->output, "    ; Store variable %s\n", 
-                   node->data.variable_declaration.name);
-            fprintf(codegen->output, "    movsd qword [rbp-%d], xmm0\n\n", 
-                   codegen->symbol_table->current_offset);
+            if (codegen->comments) {
+                EMIT_LITERAL(&codegen->out, "    ; Store variable ");
+                emit_string(&codegen->out, node->data.variable_declaration.name);
+                emit_char(&codegen->out, '\n');
+            }
+            EMIT_LITERAL(&codegen->out, "    movsd qword [rbp-");
+            emit_int(&codegen->out, offset);
+            EMIT_LITERAL(&codegen->out, "], xmm0\n\n");
+            codegen->instruction_count += 1;
             break;
         }
         case AST_PRINT_STATEMENT: {
-            fprintf(codegen->output, "    ; Print statement\n");
+            codegen_comment(codegen, "    ; Print statement\n");
             codegen_expression(codegen, node->data.print_statement.expression);
             
-            fprintf(codegen->output, "    ; Call print function\n");
-            fprintf(codegen->output, "    call print_float\n\n");
+            codegen_comment(codegen, "    ; Call print function\n");
+            EMIT_LITERAL(&codegen->out, "    call print_float\n\n");
+            codegen->instruction_count += 1;
             break;
         }
         case AST_PROGRAM:
         case AST_BINARY_EXPRESSION:
         case AST_IDENTIFIER:
         case AST_NUMBER:
-            fprintf(stderr, "Error: Invalid node type for statement: %d\n", node->type);
-            exit(1);
+            codegen_error(codegen, "Invalid node type for statement: %d", node->type);
+            return;
     }
 }
 
 void codegen_expression(CodeGenerator *codegen, ASTNode *node) {
     switch (node->type) {
         case AST_NUMBER: {
-            fprintf(codegen->output, "    ; Load number %g\n", node->data.number.value);
-            
-            // Create a unique label for this constant
-            char label[32];
-            snprintf(label, sizeof(label), "float_const_%d", codegen->label_counter++);
+            if (codegen->comments) {
+                EMIT_LITERAL(&codegen->out, "    ; Load number ");
+                emit_double(&codegen->out, "%g", node->data.number.value);
+                emit_char(&codegen->out, '\n');
+            }
             
             // Store the constant in .rodata section (we'll add it at the end)
             // For now, use a temporary approach with manual bit manipulation
@@ -167,45 +639,59 @@ void codegen_expression(CodeGenerator *codegen, ASTNode *node) {
             } converter;
             converter.d = node->data.number.value;
             
-            fprintf(codegen->output, "    mov rax, 0x%lx    ; Load float bits\n", converter.i);
-            fprintf(codegen->output, "    movq xmm0, rax\n");
+            EMIT_LITERAL(&codegen->out, "    mov rax, 0x");
+            emit_hex(&codegen->out, converter.i);
+            if (codegen->comments) EMIT_LITERAL(&codegen->out, "    ; Load float bits");
+            EMIT_LITERAL(&codegen->out, "\n    movq xmm0, rax\n");
+            codegen->instruction_count += 2;
             break;
         }
         case AST_IDENTIFIER: {
             Symbol *symbol = symbol_table_lookup(codegen->symbol_table, 
                                                 node->data.identifier.name);
             if (symbol) {
-                fprintf(codegen->output, "    ; Load variable %s\n", node->data.identifier.name);
-                fprintf(codegen->output, "    movsd xmm0, qword [rbp-%d]\n", 
-                       symbol->stack_offset);
+                if (codegen->comments) {
+                    EMIT_LITERAL(&codegen->out, "    ; Load variable ");
+                    emit_string(&codegen->out, node->data.identifier.name);
+                    emit_char(&codegen->out, '\n');
+                }
+                EMIT_LITERAL(&codegen->out, "    movsd xmm0, qword [rbp-");
+                emit_int(&codegen->out, symbol->stack_offset);
+                EMIT_LITERAL(&codegen->out, "]\n");
+                codegen->instruction_count += 1;
             } else {
-                fprintf(stderr, "Error: Undefined variable %s\n", node->data.identifier.name);
-                exit(1);
+                codegen_error(codegen, "Undefined variable %s at line %d, column %d",
+                              node->data.identifier.name, node->line, node->column);
+                return;
             }
             break;
         }
         case AST_BINARY_EXPRESSION: {
             // Generate code for left operand (result in xmm0)
             codegen_expression(codegen, node->data.binary_expression.left);
-            fprintf(codegen->output, "    movsd qword [rsp-8], xmm0  ; Save left operand\n");
+            EMIT_LITERAL(&codegen->out, "    movsd qword [rsp-8], xmm0");
+            codegen_comment(codegen, "  ; Save left operand");
+            emit_char(&codegen->out, '\n');
             
             // Generate code for right operand (result in xmm0)
             codegen_expression(codegen, node->data.binary_expression.right);
-            fprintf(codegen->output, "    movsd xmm1, qword [rsp-8]  ; Restore left operand\n");
+            EMIT_LITERAL(&codegen->out, "    movsd xmm1, qword [rsp-8]");
+            codegen_comment(codegen, "  ; Restore left operand");
+            emit_char(&codegen->out, '\n');
             
             // Perform operation
             switch (node->data.binary_expression.operator) {
                 case TOKEN_PLUS:
-                    fprintf(codegen->output, "    addsd xmm1, xmm0\n");
+                    EMIT_LITERAL(&codegen->out, "    addsd xmm1, xmm0\n");
                     break;
                 case TOKEN_MINUS:
-                    fprintf(codegen->output, "    subsd xmm1, xmm0\n");
+                    EMIT_LITERAL(&codegen->out, "    subsd xmm1, xmm0\n");
                     break;
                 case TOKEN_STAR:
-                    fprintf(codegen->output, "    mulsd xmm1, xmm0\n");
+                    EMIT_LITERAL(&codegen->out, "    mulsd xmm1, xmm0\n");
                     break;
                 case TOKEN_SLASH:
-                    fprintf(codegen->output, "    divsd xmm1, xmm0\n");
+                    EMIT_LITERAL(&codegen->out, "    divsd xmm1, xmm0\n");
                     break;
                 case TOKEN_LET:
                 case TOKEN_PRINT:
@@ -216,17 +702,20 @@ void codegen_expression(CodeGenerator *codegen, ASTNode *node) {
                 case TOKEN_RPAREN:
                 case TOKEN_SEMICOLON:
                 case TOKEN_UNKNOWN:
-                    fprintf(stderr, "Error: Invalid operator for binary expression: %d\n", 
+                    codegen_error(codegen, "Invalid operator for binary expression: %d", 
                            node->data.binary_expression.operator);
-                    exit(1);
+                    return;
             }
-            fprintf(codegen->output, "    movsd xmm0, xmm1  ; Result in xmm0\n");
+            EMIT_LITERAL(&codegen->out, "    movsd xmm0, xmm1");
+            codegen_comment(codegen, "  ; Result in xmm0");
+            emit_char(&codegen->out, '\n');
+            codegen->instruction_count += 4;
             break;
         }
         case AST_PROGRAM:
         case AST_VARIABLE_DECLARATION:
         case AST_PRINT_STATEMENT:
-            fprintf(stderr, "Error: Invalid node type for expression: %d\n", node->type);
-            exit(1);
+            codegen_error(codegen, "Invalid node type for expression: %d", node->type);
+            return;
     }
 }
@@ -2,8 +2,12 @@
 #define CODEGEN_H
 
 #include "ast.h"
+#include "emitter.h"
+#include "stats.h"
+#include "pool.h"
 #include <stdio.h>
 #include <stdint.h>
+#include <sys/types.h>
 
 // Symbol table entry
 typedef struct {
@@ -17,22 +21,103 @@ typedef struct {
     int count;
     int capacity;
     int current_offset;
+    int borrowed;     // A view onto a prefix of another table, whose symbols were assigned up front
 } SymbolTable;
 
-// Code generator
+struct CodeGenerator;
+
+// One build from generated source to executable
+typedef struct {
+    const char *output_path;  // Executable to produce
+    const char *source_path;  // Keep the generated source here, or NULL to use a private temporary
+    char temp_source[256];
+    char temp_object[256];
+    FILE *stream;             // Codegen writes the target source here
+    pid_t pid;                // Child consuming the stream, or -1
+    CompileStats *stats;      // Times the assemble and link steps when not NULL
+    int debug_info;           // Have the assembler or C compiler emit DWARF debug info
+    char error[256];          // Set when a build step fails
+} BuildJob;
+
+// Backend vtable: lowers an AST into target source and builds an executable from it
 typedef struct {
+    const char *name;
+    const char *source_extension;
+    // Emit everything before the first statement
+    void (*prologue)(struct CodeGenerator *codegen);
+    // Emit one top-level statement
+    void (*statement)(struct CodeGenerator *codegen, ASTNode *node);
+    // Emit everything after the last statement
+    void (*epilogue)(struct CodeGenerator *codegen);
+    // Open job->stream for codegen. Returns 0 on success
+    int (*build_begin)(BuildJob *job);
+    // Close job->stream and produce job->output_path. Returns 0 on success
+    int (*build_finish)(BuildJob *job);
+    // Close job->stream and discard everything the build started
+    void (*build_abort)(BuildJob *job);
+    // Attribute the code that follows to `line` of codegen->script_path; line 0
+    // marks generated code that belongs to no line of the script
+    void (*line_directive)(struct CodeGenerator *codegen, int line);
+    // Profiling (--profile): start and stop the cycle counter of statement `index`
+    void (*profile_enter)(struct CodeGenerator *codegen, int index);
+    void (*profile_exit)(struct CodeGenerator *codegen, int index);
+} Backend;
+
+// Written by profiled programs when they exit, to CodeGenerator.profile_path:
+// the magic, a u64 statement count, a u64 script path length and the path
+// (zero-padded to 8 bytes), a u64 source line per statement, then per
+// statement u64 cycles and u64 hits
+#define PROFILE_FILE "vemora.prof"    // When there is no executable to name it after
+#define PROFILE_EXTENSION ".prof"     // Appended to the executable's path by default
+#define PROFILE_MAGIC "VMPROF2\n"
+
+// Available backends
+extern const Backend backend_nasm;
+extern const Backend backend_c;
+
+// Look up a backend by name ("asm" or "c"), NULL if unknown
+const Backend* backend_lookup(const char *name);
+
+// Code generator
+typedef struct CodeGenerator {
     FILE *output;
+    Emitter out;      // Buffered output, flushed to `output` (kept in memory if NULL)
+    int comments;     // Annotate generated statements with comments
+    int profile;      // Count cycles and hits per statement and write profile_path at exit
+    const char *profile_path;  // Relative paths resolve against the program's working directory
+    int profile_count;  // Statements with counters, known by the time the epilogue runs
+    int *profile_lines; // Source line of each counted statement (profile_count entries)
+    const char *profile_script;  // Script named in the profile, or NULL
+    const char *script_path;  // Emit line directives naming this script, or NULL for none
+    const char *output_name;  // What the assembler or compiler calls the generated source
+    ThreadPool *pool; // Workers for lowering statements; large programs are split when set
+    int jobs;         // Without a pool, start one of this many workers once a program is large enough
+    int owns_pool;    // pool was started here and is freed with the generator
+    const Backend *backend;
     SymbolTable *symbol_table;
-    int label_counter;
+    long instruction_count;  // Instructions (C statements for the C backend) emitted so far
+    int had_error;
+    char error[256];  // First error; generation continues but the output is unusable
 } CodeGenerator;
 
 // Code generator functions
-CodeGenerator* codegen_create(FILE *output);
+CodeGenerator* codegen_create(FILE *output, const Backend *backend);
 void codegen_free(CodeGenerator *codegen);
-void codegen_generate(CodeGenerator *codegen, ASTNode *ast);
+// Returns 0 on success, otherwise codegen->error describes the failure
+int codegen_generate(CodeGenerator *codegen, ASTNode *ast);
+void codegen_error(CodeGenerator *codegen, const char *format, ...);
+void codegen_statement(CodeGenerator *codegen, ASTNode *node);
+
+// Give a declared variable the next stack slot. Returns its offset
+int codegen_declare(CodeGenerator *codegen, const char *name);
+
+// Record a build failure in job->error
+void build_error(BuildJob *job, const char *format, ...);
 
 // Symbol table functions
 SymbolTable* symbol_table_create();
+// Read-only view of the first `count` symbols of table; declarations reveal the next ones
+SymbolTable* symbol_table_view(SymbolTable *table, int count);
 void symbol_table_free(SymbolTable *table);
 void symbol_table_add(SymbolTable *table, const char *name, int offset);
 Symbol* symbol_table_lookup(SymbolTable *table, const char *name);
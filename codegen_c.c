@@ -0,0 +1,284 @@
+#include "codegen.h"
+#include "process.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Portable C backend: emits a self-contained translation unit and lets the
+// system compiler optimize it
+
+static void c_expression(CodeGenerator *codegen, ASTNode *node);
+
+// cc reads the translation unit from a pipe, so it starts compiling while we
+// are still generating. When the source is to be kept it goes to disk first
+static int c_build_begin(BuildJob *job) {
+    job->pid = -1;
+    job->temp_source[0] = '\0';
+    job->temp_object[0] = '\0';
+
+    if (job->source_path) {
+        job->stream = fopen(job->source_path, "we");
+        if (job->stream == NULL) {
+            build_error(job, "Error creating C source file");
+            return 1;
+        }
+        return 0;
+    }
+
+    char *cc_argv[] = {"cc", "-O2", "-x", "c", "-", "-o", (char*)job->output_path, NULL, NULL};
+    if (job->debug_info) cc_argv[7] = "-g";
+    job->stream = process_spawn_writer(cc_argv, &job->pid);
+    if (job->stream == NULL) {
+        build_error(job, "Error running cc command");
+        return 1;
+    }
+    return 0;
+}
+
+static int c_build_finish(BuildJob *job) {
+    int result = 0;
+
+    if (fclose(job->stream) != 0) {
+        result = 1;
+    }
+
+    // cc compiles and links in one go; all of it counts as the assemble step
+    StatsTimer timer;
+    stats_start(job->stats, &timer);
+    if (job->pid >= 0) {
+        if (process_wait(job->pid) != 0) {
+            result = 1;
+        }
+    } else if (result == 0) {
+        char *cc_argv[] = {"cc", "-O2", "-x", "c", (char*)job->source_path,
+                           "-o", (char*)job->output_path, NULL, NULL};
+        if (job->debug_info) cc_argv[7] = "-g";
+        if (process_run(cc_argv) != 0) {
+            result = 1;
+        }
+    }
+    stats_stop(job->stats, PHASE_ASSEMBLE, &timer);
+
+    if (result != 0) {
+        build_error(job, "Error running cc command");
+    }
+    return result;
+}
+
+static void c_build_abort(BuildJob *job) {
+    // Kill cc before closing the pipe, otherwise it compiles (and complains
+    // about) the truncated translation unit
+    if (job->pid >= 0) {
+        process_kill_group(job->pid);
+    }
+    fclose(job->stream);
+}
+
+// Body of a C string literal holding `string`
+static void c_emit_string(CodeGenerator *codegen, const char *string) {
+    for (const char *p = string; *p; p++) {
+        if (*p == '"' || *p == '\\') emit_char(&codegen->out, '\\');
+        emit_char(&codegen->out, *p);
+    }
+}
+
+static void c_prologue(CodeGenerator *codegen) {
+    codegen->out.count_lines = codegen->script_path != NULL;
+    EMIT_LITERAL(&codegen->out,
+        "#include <stdio.h>\n"
+        "#include <stdint.h>\n\n");
+
+    // Mirrors print_float in the NASM backend: truncate to a 64-bit integer
+    // (out of range and NaN become INT64_MIN, like cvttsd2si) and print the
+    // bits as an unsigned decimal
+    EMIT_LITERAL(&codegen->out,
+        "static void print_float(double x) {\n"
+        "    int64_t i = (x > -9223372036854775808.0 && x < 9223372036854775808.0) ? (int64_t)x : INT64_MIN;\n"
+        "    printf(\"%llu\\n\", (unsigned long long)(uint64_t)i);\n"
+        "}\n\n");
+
+    // The counter array is completed after main, once the statement count is known
+    if (codegen->profile) {
+        EMIT_LITERAL(&codegen->out,
+            "#include <x86intrin.h>\n\n"
+            "extern unsigned long long profile_counters[][2];\n"
+            "static unsigned long long profile_start;\n"
+            "static void profile_write(void);\n\n"
+            "static inline unsigned long long profile_now(void) {\n"
+            "    _mm_lfence();\n"
+            "    return __rdtsc();\n"
+            "}\n\n");
+    }
+
+    EMIT_LITERAL(&codegen->out, "int main(void) {\n");
+}
+
+static void c_epilogue(CodeGenerator *codegen) {
+    if (codegen->profile) {
+        EMIT_LITERAL(&codegen->out, "    profile_write();\n");
+    }
+    EMIT_LITERAL(&codegen->out,
+        "    return 0;\n"
+        "}\n");
+
+    if (codegen->profile) {
+        // One extra row keeps the array valid for an empty program
+        EMIT_LITERAL(&codegen->out, "\nunsigned long long profile_counters[");
+        emit_int(&codegen->out, codegen->profile_count + 1);
+        EMIT_LITERAL(&codegen->out, "][2];\n\n"
+            "static const unsigned long long profile_lines[] = {");
+        for (int i = 0; i < codegen->profile_count; i++) {
+            emit_string(&codegen->out, i % 16 == 0 ? "\n    " : " ");
+            emit_int(&codegen->out, codegen->profile_lines[i]);
+            emit_char(&codegen->out, ',');
+        }
+        EMIT_LITERAL(&codegen->out, "\n    0\n};\n"
+            "static const char profile_script[] = \"");
+        c_emit_string(codegen, codegen->profile_script ? codegen->profile_script : "");
+        EMIT_LITERAL(&codegen->out, "\";\n\n"
+            "static void profile_write(void) {\n"
+            "    FILE *file = fopen(\"");
+        c_emit_string(codegen, codegen->profile_path);
+        EMIT_LITERAL(&codegen->out, "\", \"wb\");\n"
+            "    if (file == NULL) return;\n"
+            "    static const char padding[8];\n"
+            "    unsigned long long count = ");
+        emit_int(&codegen->out, codegen->profile_count);
+        EMIT_LITERAL(&codegen->out, ";\n"
+            "    unsigned long long script_length = sizeof(profile_script) - 1;\n"
+            "    fwrite(\"VMPROF2\\n\", 1, 8, file);\n"
+            "    fwrite(&count, sizeof(count), 1, file);\n"
+            "    fwrite(&script_length, sizeof(script_length), 1, file);\n"
+            "    fwrite(profile_script, 1, script_length, file);\n"
+            "    fwrite(padding, 1, (8 - script_length % 8) % 8, file);\n"
+            "    fwrite(profile_lines, sizeof(profile_lines[0]), count, file);\n"
+            "    fwrite(profile_counters, sizeof(profile_counters[0]), count, file);\n"
+            "    fclose(file);\n"
+            "}\n");
+    }
+}
+
+// Line 0 hands attribution back to the generated source. C has no "no line"
+// marker, so that means its real position, which the emitter counts once
+// directives are in use
+static void c_line_directive(CodeGenerator *codegen, int line) {
+    EMIT_LITERAL(&codegen->out, "#line ");
+    if (line == 0) {
+        // The directive is on line count + 1, so the code after it on count + 2
+        emit_int(&codegen->out, emitter_line_count(&codegen->out) + 2);
+        EMIT_LITERAL(&codegen->out, " \"");
+        c_emit_string(codegen, codegen->output_name);
+    } else {
+        emit_int(&codegen->out, line);
+        EMIT_LITERAL(&codegen->out, " \"");
+        c_emit_string(codegen, codegen->script_path);
+    }
+    EMIT_LITERAL(&codegen->out, "\"\n");
+}
+
+static void c_profile_enter(CodeGenerator *codegen, int index) {
+    (void)index;
+    EMIT_LITERAL(&codegen->out, "    profile_start = profile_now();\n");
+}
+
+static void c_profile_exit(CodeGenerator *codegen, int index) {
+    EMIT_LITERAL(&codegen->out, "    profile_counters[");
+    emit_int(&codegen->out, index);
+    EMIT_LITERAL(&codegen->out, "][0] += profile_now() - profile_start;\n    profile_counters[");
+    emit_int(&codegen->out, index);
+    EMIT_LITERAL(&codegen->out, "][1]++;\n");
+}
+
+static void c_statement(CodeGenerator *codegen, ASTNode *node) {
+    switch (node->type) {
+        case AST_VARIABLE_DECLARATION: {
+            // Slots map to C variables one to one, same as stack slots in the NASM
+            // backend. The value is generated before declaring, so it still sees
+            // any earlier variable of the same name
+            int offset = codegen->symbol_table->current_offset + 8;
+
+            EMIT_LITERAL(&codegen->out, "    double v");
+            emit_int(&codegen->out, offset / 8);
+            EMIT_LITERAL(&codegen->out, " = ");
+            c_expression(codegen, node->data.variable_declaration.value);
+            EMIT_LITERAL(&codegen->out, ";\n");
+
+            codegen_declare(codegen, node->data.variable_declaration.name);
+            codegen->instruction_count += 1;
+            break;
+        }
+        case AST_PRINT_STATEMENT: {
+            EMIT_LITERAL(&codegen->out, "    print_float(");
+            c_expression(codegen, node->data.print_statement.expression);
+            EMIT_LITERAL(&codegen->out, ");\n");
+            codegen->instruction_count += 1;
+            break;
+        }
+        case AST_PROGRAM:
+        case AST_BINARY_EXPRESSION:
+        case AST_IDENTIFIER:
+        case AST_NUMBER:
+            codegen_error(codegen, "Invalid node type for statement: %d", node->type);
+            return;
+    }
+}
+
+static void c_expression(CodeGenerator *codegen, ASTNode *node) {
+    switch (node->type) {
+        case AST_NUMBER:
+            // Hex float literals round-trip the exact double
+            emit_double(&codegen->out, "%a", node->data.number.value);
+            break;
+        case AST_IDENTIFIER: {
+            Symbol *symbol = symbol_table_lookup(codegen->symbol_table,
+                                                node->data.identifier.name);
+            if (symbol) {
+                emit_char(&codegen->out, 'v');
+                emit_int(&codegen->out, symbol->stack_offset / 8);
+            } else {
+                codegen_error(codegen, "Undefined variable %s at line %d, column %d",
+                              node->data.identifier.name, node->line, node->column);
+                return;
+            }
+            break;
+        }
+        case AST_BINARY_EXPRESSION: {
+            char op;
+            switch (node->data.binary_expression.operator) {
+                case TOKEN_PLUS: op = '+'; break;
+                case TOKEN_MINUS: op = '-'; break;
+                case TOKEN_STAR: op = '*'; break;
+                case TOKEN_SLASH: op = '/'; break;
+                default:
+                    codegen_error(codegen, "Invalid operator for binary expression: %d",
+                           node->data.binary_expression.operator);
+                    return;
+            }
+            emit_char(&codegen->out, '(');
+            c_expression(codegen, node->data.binary_expression.left);
+            char spaced[3] = {' ', op, ' '};
+            emit_bytes(&codegen->out, spaced, 3);
+            c_expression(codegen, node->data.binary_expression.right);
+            emit_char(&codegen->out, ')');
+            break;
+        }
+        case AST_PROGRAM:
+        case AST_VARIABLE_DECLARATION:
+        case AST_PRINT_STATEMENT:
+            codegen_error(codegen, "Invalid node type for expression: %d", node->type);
+            return;
+    }
+}
+
+const Backend backend_c = {
+    .name = "c",
+    .source_extension = "c",
+    .prologue = c_prologue,
+    .statement = c_statement,
+    .epilogue = c_epilogue,
+    .build_begin = c_build_begin,
+    .build_finish = c_build_finish,
+    .build_abort = c_build_abort,
+    .line_directive = c_line_directive,
+    .profile_enter = c_profile_enter,
+    .profile_exit = c_profile_exit,
+};
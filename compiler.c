@@ -0,0 +1,229 @@
+#include "compiler.h"
+#include "token.h"
+#include "ast.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <limits.h>
+
+char* read_file(const char *path, size_t *length) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+
+    size_t capacity = 4096;
+    size_t size = 0;
+    char *data = stats_malloc(capacity);
+    size_t n;
+    while ((n = fread(data + size, 1, capacity - size - 1, file)) > 0) {
+        size += n;
+        if (capacity - size - 1 == 0) {
+            capacity *= 2;
+            data = stats_realloc(data, capacity);
+        }
+    }
+
+    int failed = ferror(file);
+    fclose(file);
+    if (failed) {
+        free(data);
+        return NULL;
+    }
+
+    data[size] = '\0';
+    if (length) *length = size;
+    return data;
+}
+
+// Tokenize and parse. Returns NULL and fills result on a syntax error
+static ASTNode* parse_source(const char *data, bool debug, CompileStats *stats, CompileResult *result) {
+    StatsTimer timer;
+    stats_start(stats, &timer);
+    TokenArray* tokens = tokenize(data);
+    stats_stop(stats, PHASE_TOKENIZE, &timer);
+    if (stats) stats->tokens = tokens->count;
+
+    debug && printf("\nTokens:\n");
+    for (int i = 0; debug && i < tokens->count; i++) {
+        char *token_str = token_to_string(tokens->tokens[i]);
+        printf("%s ", token_str);
+        free(token_str);
+    }
+    debug && printf("\n");
+
+    debug && printf("\nv v v\n");
+
+    debug && printf("\nAST:\n");
+    stats_start(stats, &timer);
+    Parser *parser = parser_create(tokens);
+    ASTNode *ast = parse_program(parser);
+    stats_stop(stats, PHASE_PARSE, &timer);
+    if (stats) stats->nodes = ast_count_nodes(ast);
+
+    if (parser->had_error) {
+        snprintf(result->error, sizeof(result->error), "Parser error: %s", parser->error);
+        result->status = 1;
+        ast_node_free(ast);
+        ast = NULL;
+    } else if (debug) {
+        ast_print(ast, 0);
+        printf("\nv v v\n");
+    }
+
+    // The AST owns copies of every name, so the tokens can go
+    parser_free(parser);
+    token_array_free(tokens);
+    return ast;
+}
+
+const char* compile_profile_path(const CompileOptions *options, char *path, size_t size) {
+    if (options->profile_path) return options->profile_path;
+    if (options->output_path == NULL) return PROFILE_FILE;
+    snprintf(path, size, "%s" PROFILE_EXTENSION, options->output_path);
+    return path;
+}
+
+void compile_flags(const CompileOptions *options, char *flags, size_t size) {
+    // Debug info and profiles embed the script path, and profiles their own
+    // path, so those become part of the key
+    char profile_buffer[PATH_MAX + 8];
+    const char *profile_path = options->profile ? compile_profile_path(options, profile_buffer, sizeof(profile_buffer)) : NULL;
+    bool debug_info = options->debug_info && options->script_path;
+    bool profile_script = options->profile && options->script_path;
+    snprintf(flags, size, "%s%s%s%s%s%s%s", options->backend->name, options->comments ? "" : ",no-comments",
+             profile_path ? ",profile=" : "", profile_path ? profile_path : "", debug_info ? ",debug-info" : "",
+             debug_info || profile_script ? ":" : "", debug_info || profile_script ? options->script_path : "");
+}
+
+int generate_source(const char *data, const CompileOptions *options, FILE *output, CompileResult *result) {
+    result->status = 0;
+    result->cached = false;
+    result->error[0] = '\0';
+
+    ASTNode *ast = parse_source(data, false, options->stats, result);
+    if (ast == NULL) {
+        return 1;
+    }
+
+    char profile_path[PATH_MAX + 8];
+    CodeGenerator *codegen = codegen_create(output, options->backend);
+    codegen->comments = options->comments;
+    codegen->profile = options->profile;
+    codegen->script_path = options->debug_info ? options->script_path : NULL;
+    codegen->profile_script = options->script_path;
+    codegen->profile_path = compile_profile_path(options, profile_path, sizeof(profile_path));
+    codegen->pool = options->codegen_pool;
+    codegen->jobs = options->codegen_jobs;
+    if (codegen_generate(codegen, ast) != 0) {
+        snprintf(result->error, sizeof(result->error), "Error: %s", codegen->error);
+        result->status = 1;
+    }
+
+    codegen_free(codegen);
+    ast_node_free(ast);
+    return result->status;
+}
+
+int compile_source(const char *data, size_t length, const CompileOptions *options, CompileResult *result) {
+    bool debug = options->debug;
+    const Backend *backend = options->backend;
+
+    result->status = 0;
+    result->cached = false;
+    result->error[0] = '\0';
+
+    // Everything after hashing is skipped on a cache hit
+    uint64_t key = 0;
+    if (options->cache) {
+        char flags[2 * PATH_MAX + 64];
+        compile_flags(options, flags, sizeof(flags));
+        key = cache_key(data, length, flags);
+        if (cache_lookup(options->cache, key, options->output_path, options->source_path)) {
+            debug && printf("\nCache hit, executable restored as '%s'\n", options->output_path);
+            result->cached = true;
+            if (options->stats) options->stats->cached = true;
+            return 0;
+        }
+    }
+
+    ASTNode *ast = parse_source(data, debug, options->stats, result);
+    if (ast == NULL) {
+        return 1;
+    }
+
+    // Generate target source straight into the backend's build
+    debug && printf("\nGenerating %s...\n", backend->name);
+    BuildJob job = {0};
+    job.output_path = options->output_path;
+    job.source_path = options->source_path;
+    job.stats = options->stats;
+    job.debug_info = options->debug_info && options->script_path;
+    if (backend->build_begin(&job) != 0) {
+        snprintf(result->error, sizeof(result->error), "%s", job.error);
+        result->status = 1;
+    }
+
+    CodeGenerator *codegen = NULL;
+    char profile_path[PATH_MAX + 8];
+    if (result->status == 0) {
+        codegen = codegen_create(job.stream, backend);
+        if (job.source_path) {
+            codegen->output_name = job.source_path;
+        } else if (job.temp_source[0]) {
+            codegen->output_name = job.temp_source;
+        }
+        codegen->comments = options->comments;
+        codegen->profile = options->profile;
+        codegen->script_path = options->debug_info ? options->script_path : NULL;
+        codegen->profile_script = options->script_path;
+        codegen->profile_path = compile_profile_path(options, profile_path, sizeof(profile_path));
+        codegen->pool = options->codegen_pool;
+        codegen->jobs = options->codegen_jobs;
+
+        struct timespec start, end;
+        StatsTimer timer;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        stats_start_process(options->stats, &timer);
+        int generated = codegen_generate(codegen, ast);
+        stats_stop(options->stats, PHASE_CODEGEN, &timer);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        if (options->stats) {
+            options->stats->symbols = codegen->symbol_table->count;
+            options->stats->instructions = codegen->instruction_count;
+            options->stats->output_bytes = codegen->out.total;
+        }
+
+        double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        debug && printf("Generated %zu bytes in %.3f ms (%.1f MB/s)\n", codegen->out.total,
+                        seconds * 1e3, seconds > 0 ? codegen->out.total / seconds / 1e6 : 0.0);
+
+        if (generated != 0) {
+            backend->build_abort(&job);
+            snprintf(result->error, sizeof(result->error), "Error: %s", codegen->error);
+            result->status = 1;
+        } else {
+            debug && printf("Compiling...\n");
+            if (backend->build_finish(&job) != 0) {
+                snprintf(result->error, sizeof(result->error), "%s", job.error);
+                result->status = 1;
+            }
+        }
+    }
+
+    if (codegen) codegen_free(codegen);
+    ast_node_free(ast);
+
+    if (result->status != 0) {
+        return 1;
+    }
+
+    if (options->cache) {
+        cache_store(options->cache, key, options->output_path, options->source_path);
+    }
+
+    debug && printf("Compilation successful. Executable created as '%s'\n", options->output_path);
+    return 0;
+}
@@ -0,0 +1,50 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "codegen.h"
+#include "cache.h"
+#include "stats.h"
+
+// Options for compiling one source into an executable
+typedef struct {
+    const Backend *backend;
+    const char *output_path;  // Executable to produce
+    const char *source_path;  // Keep the generated source here, or NULL
+    Cache *cache;             // Optional compilation cache
+    bool comments;            // Annotate generated code with comments
+    bool profile;             // Instrument statements with cycle counters (--profile)
+    const char *profile_path; // Profile the program writes, or NULL for output_path + PROFILE_EXTENSION
+    bool debug_info;          // Map generated code back to script_path lines (--debug-info)
+    const char *script_path;  // Script being compiled, as named in debug info
+    ThreadPool *codegen_pool; // Workers for code generation, owned by the caller, or NULL
+    int codegen_jobs;         // Without codegen_pool, threads to start for a large program (0 or 1: serial)
+    CompileStats *stats;      // Per-phase instrumentation, or NULL
+    bool debug;               // Print tokens and AST (single-file mode only)
+} CompileOptions;
+
+// Outcome of one compilation. Everything a failure needs to report lives
+// here, so compilations can run side by side on different threads
+typedef struct {
+    int status;       // 0 on success
+    bool cached;      // Executable was restored from the cache
+    char error[320];  // Human readable error when status != 0
+} CompileResult;
+
+// Tokenize, parse, generate and build one source
+int compile_source(const char *data, size_t length, const CompileOptions *options, CompileResult *result);
+
+// Tokenize, parse and generate target source into output without building it
+int generate_source(const char *data, const CompileOptions *options, FILE *output, CompileResult *result);
+
+// Where a --profile build writes its profile. Uses `path` when it has to build one
+const char* compile_profile_path(const CompileOptions *options, char *path, size_t size);
+
+// Describe everything in options that changes the generated code, for cache keys
+void compile_flags(const CompileOptions *options, char *flags, size_t size);
+
+// Read a whole file into a NUL-terminated buffer. Returns NULL on failure
+char* read_file(const char *path, size_t *length);
+
+#endif // COMPILER_H
@@ -0,0 +1,144 @@
+#include "emitter.h"
+#include "stats.h"
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+
+void emitter_init(Emitter *emitter, FILE *sink) {
+    emitter->capacity = 4096;
+    emitter->data = stats_malloc(emitter->capacity);
+    emitter->length = 0;
+    emitter->sink = sink;
+    emitter->total = 0;
+    emitter->failed = 0;
+    emitter->count_lines = 0;
+    emitter->lines_written = 0;
+}
+
+void emitter_free(Emitter *emitter) {
+    free(emitter->data);
+    emitter->data = NULL;
+    emitter->length = 0;
+    emitter->capacity = 0;
+}
+
+void emitter_reserve(Emitter *emitter, size_t size) {
+    // With a sink, flushing is cheaper than growing past the threshold
+    if (emitter->sink && emitter->length >= EMITTER_FLUSH_THRESHOLD) {
+        emitter_flush(emitter);
+    }
+    if (emitter->capacity - emitter->length >= size) {
+        return;
+    }
+
+    size_t capacity = emitter->capacity ? emitter->capacity : 4096;
+    while (capacity - emitter->length < size) {
+        capacity *= 2;
+    }
+    emitter->data = stats_realloc(emitter->data, capacity);
+    emitter->capacity = capacity;
+}
+
+// Write straight to the descriptor; memory streams have none and go through stdio
+static size_t count_newlines(const char *bytes, size_t length) {
+    size_t count = 0;
+    const char *end = bytes + length;
+    while ((bytes = memchr(bytes, '\n', end - bytes)) != NULL) {
+        count++;
+        bytes++;
+    }
+    return count;
+}
+
+size_t emitter_line_count(const Emitter *emitter) {
+    return emitter->lines_written + count_newlines(emitter->data, emitter->length);
+}
+
+static void emitter_write_sink(Emitter *emitter, const char *bytes, size_t length) {
+    if (emitter->count_lines) emitter->lines_written += count_newlines(bytes, length);
+    int fd = fileno(emitter->sink);
+    if (fd >= 0 && fflush(emitter->sink) == 0) {
+        while (length > 0) {
+            ssize_t n = write(fd, bytes, length);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                emitter->failed = 1;
+                break;
+            }
+            bytes += n;
+            length -= n;
+        }
+    } else if (fwrite(bytes, 1, length, emitter->sink) != length) {
+        emitter->failed = 1;
+    }
+}
+
+int emitter_flush(Emitter *emitter) {
+    if (emitter->sink == NULL || emitter->length == 0) {
+        return emitter->failed;
+    }
+
+    emitter_write_sink(emitter, emitter->data, emitter->length);
+    emitter->length = 0;
+    return emitter->failed;
+}
+
+void emitter_append(Emitter *emitter, const char *bytes, size_t length) {
+    if (emitter->sink == NULL || length < EMITTER_FLUSH_THRESHOLD) {
+        emit_bytes(emitter, bytes, length);
+        return;
+    }
+
+    emitter_flush(emitter);
+    emitter_write_sink(emitter, bytes, length);
+    emitter->total += length;
+}
+
+char* emitter_take(Emitter *emitter, size_t *length) {
+    emitter_reserve(emitter, 1);
+    emitter->data[emitter->length] = '\0';
+
+    char *data = emitter->data;
+    if (length) *length = emitter->length;
+
+    emitter->capacity = 4096;
+    emitter->data = stats_malloc(emitter->capacity);
+    emitter->length = 0;
+    return data;
+}
+
+void emit_int(Emitter *emitter, long long value) {
+    char buffer[24];
+    char *end = buffer + sizeof(buffer);
+    char *p = end;
+
+    unsigned long long magnitude = value < 0 ? 0ULL - (unsigned long long)value : (unsigned long long)value;
+    do {
+        *--p = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude);
+    if (value < 0) *--p = '-';
+
+    emit_bytes(emitter, p, end - p);
+}
+
+void emit_hex(Emitter *emitter, uint64_t value) {
+    static const char digits[] = "0123456789abcdef";
+    char buffer[16];
+    char *end = buffer + sizeof(buffer);
+    char *p = end;
+
+    do {
+        *--p = digits[value & 0xf];
+        value >>= 4;
+    } while (value);
+
+    emit_bytes(emitter, p, end - p);
+}
+
+void emit_double(Emitter *emitter, const char *format, double value) {
+    // Rare enough (comments, C literals) that snprintf is fine here
+    char buffer[64];
+    int length = snprintf(buffer, sizeof(buffer), format, value);
+    emit_bytes(emitter, buffer, length);
+}
@@ -0,0 +1,71 @@
+#ifndef EMITTER_H
+#define EMITTER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// Flush to the sink once this much output is buffered
+#define EMITTER_FLUSH_THRESHOLD (256 * 1024)
+
+// Growable output buffer for generated code. Text is appended with plain
+// memcpy and hand-written number formatting instead of stdio, and reaches the
+// sink in large writes. Without a sink everything stays in memory until taken
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+    FILE *sink;     // Destination of emitter_flush, or NULL to keep the output in memory
+    size_t total;   // Bytes emitted since emitter_init
+    int failed;     // A write to the sink failed
+    int count_lines;     // Count newlines on their way to the sink (for emitter_line_count)
+    size_t lines_written;
+} Emitter;
+
+void emitter_init(Emitter *emitter, FILE *sink);
+void emitter_free(Emitter *emitter);
+
+// Make room for at least `size` more bytes
+void emitter_reserve(Emitter *emitter, size_t size);
+
+// Write buffered output to the sink. Returns non-zero if any write failed
+int emitter_flush(Emitter *emitter);
+
+// Append a block that may be large: with a sink, blocks past the flush
+// threshold are written through instead of copied into the buffer
+void emitter_append(Emitter *emitter, const char *bytes, size_t length);
+
+// Newlines emitted so far. Output that reached the sink is only counted if
+// count_lines was set before it was written
+size_t emitter_line_count(const Emitter *emitter);
+
+// Hand the buffered output to the caller as a NUL-terminated malloc'd string
+// and start over with an empty buffer
+char* emitter_take(Emitter *emitter, size_t *length);
+
+void emit_int(Emitter *emitter, long long value);
+void emit_hex(Emitter *emitter, uint64_t value);   // Lower case, no prefix
+void emit_double(Emitter *emitter, const char *format, double value);
+
+static inline void emit_bytes(Emitter *emitter, const char *bytes, size_t length) {
+    if (emitter->capacity - emitter->length < length) {
+        emitter_reserve(emitter, length);
+    }
+    memcpy(emitter->data + emitter->length, bytes, length);
+    emitter->length += length;
+    emitter->total += length;
+}
+
+static inline void emit_string(Emitter *emitter, const char *string) {
+    emit_bytes(emitter, string, strlen(string));
+}
+
+static inline void emit_char(Emitter *emitter, char c) {
+    emit_bytes(emitter, &c, 1);
+}
+
+// String literals have their length known at compile time
+#define EMIT_LITERAL(emitter, literal) emit_bytes((emitter), literal, sizeof(literal) - 1)
+
+#endif // EMITTER_H
@@ -2,16 +2,195 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
-#include "token.h"
-#include "ast.h"
+#include <limits.h>
+#include <signal.h>
+#include <errno.h>
+#include <sys/stat.h>
 #include "codegen.h"
+#include "process.h"
+#include "cache.h"
+#include "compiler.h"
+#include "pool.h"
+#include "server.h"
+#include "watch.h"
+#include "stats.h"
+#include "profile.h"
 
-#define MAX_SIZE 100
+// One input of a batch compilation
+typedef struct {
+    const char *input_path;
+    char output_path[512];
+    char source_path[512];
+    CompileOptions options;
+    CompileResult result;
+} BatchItem;
+
+static void batch_compile(void *arg) {
+    BatchItem *item = arg;
+
+    size_t length;
+    char *data = read_file(item->input_path, &length);
+    if (data == NULL) {
+        item->result.status = 1;
+        snprintf(item->result.error, sizeof(item->result.error), "Error opening file");
+        return;
+    }
+
+    compile_source(data, length, &item->options, &item->result);
+    free(data);
+}
+
+// "dir/prog.vm" compiles to "dir/prog", or to "<output_dir>/prog" when an output directory is given
+static void batch_output_path(const char *input_path, const char *output_dir, char *path, size_t size) {
+    const char *base = strrchr(input_path, '/');
+    base = base ? base + 1 : input_path;
+
+    if (output_dir) {
+        snprintf(path, size, "%s/%s", output_dir, base);
+    } else {
+        snprintf(path, size, "%s", input_path);
+    }
+
+    char *file_name = strrchr(path, '/');
+    char *extension = strrchr(file_name ? file_name : path, '.');
+    if (extension && extension != (file_name ? file_name + 1 : path)) {
+        *extension = '\0';
+    } else {
+        strncat(path, ".out", size - strlen(path) - 1);
+    }
+}
+
+// Append every non-empty line of a manifest to inputs
+static int read_manifest(const char *path, char ***inputs, int *count, int *capacity) {
+    char *data = read_file(path, NULL);
+    if (data == NULL) {
+        return 1;
+    }
+
+    for (char *line = strtok(data, "\r\n"); line; line = strtok(NULL, "\r\n")) {
+        if (line[0] == '\0' || line[0] == '#') continue;
+        if (*count >= *capacity) {
+            *capacity *= 2;
+            *inputs = realloc(*inputs, sizeof(char*) * *capacity);
+        }
+        (*inputs)[(*count)++] = strdup(line);
+    }
+
+    free(data);
+    return 0;
+}
+
+static int compare_output_paths(const void *a, const void *b) {
+    const BatchItem *x = *(BatchItem * const *)a;
+    const BatchItem *y = *(BatchItem * const *)b;
+    return strcmp(x->output_path, y->output_path);
+}
+
+// Two inputs with the same name (a/prog.vm and b/prog.vm under -o dir) would
+// race to write one executable, so refuse the batch up front
+static int batch_check_duplicates(BatchItem *items, int count) {
+    BatchItem **sorted = malloc(sizeof(BatchItem *) * (count > 0 ? count : 1));
+    for (int i = 0; i < count; i++) {
+        sorted[i] = &items[i];
+    }
+    qsort(sorted, count, sizeof(BatchItem *), compare_output_paths);
+
+    int duplicates = 0;
+    for (int i = 1; i < count; i++) {
+        if (strcmp(sorted[i - 1]->output_path, sorted[i]->output_path) == 0) {
+            printf("FAILED %s and %s both compile to %s\n", sorted[i - 1]->input_path,
+                   sorted[i]->input_path, sorted[i]->output_path);
+            duplicates++;
+        }
+    }
+    free(sorted);
+    return duplicates;
+}
+
+static int run_batch(char **inputs, int count, const char *output_dir, const CompileOptions *base,
+                     bool saveAssembly, int jobs) {
+    if (output_dir && mkdir(output_dir, 0755) != 0 && errno != EEXIST) {
+        printf("Error creating directory %s: %s\n", output_dir, strerror(errno));
+        return 1;
+    }
+
+    BatchItem *items = calloc(count, sizeof(BatchItem));
+    for (int i = 0; i < count; i++) {
+        BatchItem *item = &items[i];
+        item->input_path = inputs[i];
+        batch_output_path(inputs[i], output_dir, item->output_path, sizeof(item->output_path));
+    }
+    if (batch_check_duplicates(items, count) != 0) {
+        free(items);
+        return 1;
+    }
+
+    ThreadPool *pool = thread_pool_create(jobs);
+    for (int i = 0; i < count; i++) {
+        BatchItem *item = &items[i];
+        snprintf(item->source_path, sizeof(item->source_path), "%s.%s",
+                 item->output_path, base->backend->source_extension);
+
+        item->options = *base;
+        item->options.output_path = item->output_path;
+        item->options.source_path = saveAssembly ? item->source_path : NULL;
+        item->options.debug = false;
+        item->options.stats = NULL;
+        item->options.script_path = item->input_path;
+        // One explicit --profile=PATH would be clobbered by every program
+        item->options.profile_path = NULL;
+
+        thread_pool_submit(pool, batch_compile, item);
+    }
+
+    thread_pool_wait(pool);
+    thread_pool_free(pool);
+
+    // Report in input order regardless of completion order
+    int failed = 0;
+    for (int i = 0; i < count; i++) {
+        BatchItem *item = &items[i];
+        if (item->result.status == 0) {
+            printf("ok     %s -> %s%s\n", item->input_path, item->output_path,
+                   item->result.cached ? " (cached)" : "");
+        } else {
+            printf("FAILED %s: %s\n", item->input_path, item->result.error);
+            failed++;
+        }
+    }
+    printf("%d compiled, %d failed\n", count - failed, failed);
+
+    free(items);
+    return failed ? 1 : 0;
+}
 
 int main(int argc, char *argv[]) {
     bool onlyCompile = false;
     bool debug = false;
     bool saveAssembly = false;
+    bool batch = false;
+    bool watch = false;
+    bool comments = true;
+    bool showStats = false;
+    bool statsJson = false;
+    bool profile = false;
+    bool debugInfo = false;
+    const char *profile_path = NULL;
+    bool profileReport = false;
+    const char *profile_report_path = NULL;
+    const Backend *backend = &backend_nasm;
+    const char *output_path = NULL;
+    const char *cache_dir = getenv("VEMORA_CACHE_DIR");
+    long long cache_max_bytes = CACHE_DEFAULT_MAX_BYTES;
+    bool showCacheStats = false;
+    int jobs = thread_pool_default_size();
+    const char *serve_path = NULL;
+    const char *connect_path = NULL;
+    ServerCommand request = SERVER_RUN;
+
+    int input_count = 0;
+    int input_capacity = 16;
+    char **inputs = malloc(sizeof(char*) * input_capacity);
 
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--only-compile") == 0) {
@@ -20,95 +199,219 @@ int main(int argc, char *argv[]) {
             debug = true;
         } else if (strcmp(argv[i], "--save-assembly") == 0) {
             saveAssembly = true;
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output_path = argv[++i];
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            showStats = true;
+        } else if (strcmp(argv[i], "--stats-json") == 0) {
+            statsJson = true;
+        } else if (strcmp(argv[i], "-g") == 0 || strcmp(argv[i], "--debug-info") == 0) {
+            debugInfo = true;
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            profile = true;
+        } else if (strncmp(argv[i], "--profile=", 10) == 0) {
+            profile = true;
+            profile_path = argv[i] + 10;
+        } else if (strcmp(argv[i], "--profile-report") == 0) {
+            profileReport = true;
+        } else if (strncmp(argv[i], "--profile-report=", 17) == 0) {
+            profileReport = true;
+            profile_report_path = argv[i] + 17;
+        } else if (strcmp(argv[i], "--no-comments") == 0) {
+            comments = false;
+        } else if (strcmp(argv[i], "--watch") == 0) {
+            watch = true;
+        } else if (strcmp(argv[i], "--batch") == 0) {
+            batch = true;
+        } else if (strncmp(argv[i], "--manifest=", 11) == 0) {
+            batch = true;
+            if (read_manifest(argv[i] + 11, &inputs, &input_count, &input_capacity) != 0) {
+                printf("Error opening manifest %s\n", argv[i] + 11);
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--serve=", 8) == 0) {
+            serve_path = argv[i] + 8;
+        } else if (strncmp(argv[i], "--connect=", 10) == 0) {
+            connect_path = argv[i] + 10;
+        } else if (strncmp(argv[i], "--request=", 10) == 0) {
+            const char *name = argv[i] + 10;
+            if (strcmp(name, "generate") == 0) {
+                request = SERVER_GENERATE;
+            } else if (strcmp(name, "build") == 0) {
+                request = SERVER_BUILD;
+            } else if (strcmp(name, "run") == 0) {
+                request = SERVER_RUN;
+            } else {
+                printf("Unknown request: %s\n", name);
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--jobs=", 7) == 0) {
+            jobs = thread_pool_clamp_size(atoi(argv[i] + 7));
+        } else if (strncmp(argv[i], "--cache-dir=", 12) == 0) {
+            cache_dir = argv[i] + 12;
+        } else if (strncmp(argv[i], "--cache-max-size=", 17) == 0) {
+            cache_max_bytes = atoll(argv[i] + 17);
+        } else if (strcmp(argv[i], "--cache-stats") == 0) {
+            showCacheStats = true;
+        } else if (strncmp(argv[i], "--emit=", 7) == 0) {
+            backend = backend_lookup(argv[i] + 7);
+            if (backend == NULL) {
+                printf("Unknown backend: %s\n", argv[i] + 7);
+                return 1;
+            }
+        } else if (argv[i][0] != '-') {
+            if (input_count >= input_capacity) {
+                input_capacity *= 2;
+                inputs = realloc(inputs, sizeof(char*) * input_capacity);
+            }
+            inputs[input_count++] = strdup(argv[i]);
         }
     }
 
-    if (argc < 2) {
-        printf("No file selected\n");
-        return 1;
-    }
-    
-    char *file_path = argv[argc - 1];
-    
-    // Now you can use file_path to open and process the file
-    FILE *file = fopen(file_path, "r");
-    if (file == NULL) {
-        printf("Error opening file\n");
-        return 1;
+    // A build tool exiting early must surface as an error, not kill us
+    signal(SIGPIPE, SIG_IGN);
+
+    // The source is optional here; the profile names the script it came from.
+    // Without a path, read the profile a --profile build of -o would write
+    if (profileReport) {
+        char default_path[PATH_MAX + 8];
+        if (profile_report_path == NULL) {
+            snprintf(default_path, sizeof(default_path), "%s" PROFILE_EXTENSION, output_path ? output_path : "output");
+            profile_report_path = default_path;
+        }
+        return profile_report(profile_report_path, input_count > 0 ? inputs[0] : NULL, 20);
     }
 
-    char data[MAX_SIZE];
-    int n = fread(data, 1, MAX_SIZE - 1, file);
-
-    data[n] = '\0';
-    debug && printf("\nSource Code:\n%s\n", data);
-    
-    debug && printf("\nv v v\n");
-    
-    debug && printf("\nTokens:\n");
-    TokenArray* tokens = tokenize(data);
-    for (int i = 0; i < tokens->count; i++) {
-        Token token = tokens->tokens[i];
-        char *token_str = token_to_string(token);
-        debug && printf("%s ", token_str);
-        free(token_str);
-    }
-    debug && printf("\n");
-    
-    debug && printf("\nv v v\n");
-
-    debug && printf("\nAST:\n");
-    Parser *parser = parser_create(tokens);
-    ASTNode *ast = parse_program(parser);
-    if(debug)
-        ast_print(ast, 0);
-
-    debug && printf("\nv v v\n");
-
-    // Generate assembly
-    debug && printf("\nGenerating assembly...\n");
-    FILE *asm_file = fopen("output.asm", "w");
-    if (asm_file == NULL) {
-        printf("Error creating assembly file\n");
+    if (input_count == 0 && serve_path == NULL) {
+        printf("No file selected\n");
         return 1;
     }
-    
-    CodeGenerator *codegen = codegen_create(asm_file);
-    codegen_generate(codegen, ast);
-    fclose(asm_file);
-    
-    debug && printf("Assembly generated in output.asm\n");
-    // Compile the generated assembly
-    debug && printf("Compiling the assembly...\n");
-    int nasm_result = system("nasm -f elf64 output.asm -o output.o");
-    if (nasm_result != 0) {
-        printf("Error running nasm command\n");
-        return 1;
+
+    if (connect_path) {
+        size_t length;
+        char *data = read_file(inputs[0], &length);
+        if (data == NULL) {
+            printf("Error opening file\n");
+            return 1;
+        }
+        int result = server_request(connect_path, request, backend, data, length);
+        free(data);
+        return result;
     }
-    
-    int ld_result = system("ld output.o -o output");
-    if (ld_result != 0) {
-        printf("Error running ld command\n");
-        return 1;
+
+    CompileOptions options = {0};
+    options.backend = backend;
+    options.debug = debug;
+    options.comments = comments;
+    options.profile = profile;
+    options.profile_path = profile_path;
+    options.debug_info = debugInfo;
+    if (cache_dir) {
+        options.cache = cache_open(cache_dir, cache_max_bytes);
+        if (options.cache == NULL) {
+            printf("Error opening cache directory %s\n", cache_dir);
+            return 1;
+        }
     }
-    
-    debug && printf("Compilation successful. Executable created as 'output'\n");
 
-    // Run the script
-    if (!onlyCompile) {
-        system("rm -rf ./output.o");
-        if(!saveAssembly) {
-            system("rm -rf ./output.asm");
+    int exit_code = 0;
+    if (serve_path) {
+        exit_code = server_run(serve_path, &options, jobs);
+    } else if (watch) {
+        if (output_path == NULL) output_path = "output";
+        char source_path[512];
+        snprintf(source_path, sizeof(source_path), "%s.%s", output_path, backend->source_extension);
+        options.output_path = output_path;
+        options.source_path = saveAssembly ? source_path : NULL;
+        // Incremental rebuilds bypass the cache; every build reuses the previous one instead
+        options.cache = NULL;
+        // Counters are sized for the whole program, which watch never generates in one go,
+        // and reused statement code would carry stale line directives
+        options.profile = false;
+        options.debug_info = false;
+        exit_code = watch_run(inputs[0], &options, !onlyCompile);
+    } else if (batch || input_count > 1) {
+        // Batch mode only compiles; -o names the output directory
+        exit_code = run_batch(inputs, input_count, output_path, &options, saveAssembly, jobs);
+    } else {
+        const char *file_path = inputs[0];
+        if (output_path == NULL) output_path = "output";
+
+        CompileStats stats;
+        CompileStats *stats_pointer = NULL;
+        StatsTimer timer;
+        if (showStats || statsJson) {
+            stats_init(&stats);
+            stats_pointer = &stats;
+            options.stats = stats_pointer;
+        }
+
+        stats_start(stats_pointer, &timer);
+        size_t length;
+        char *data = read_file(file_path, &length);
+        stats_stop(stats_pointer, PHASE_READ, &timer);
+        // Failures fall through to the shared cleanup below
+        int failed = 1;
+        if (data == NULL) {
+            printf("Error opening file\n");
+        } else {
+            debug && printf("\nSource Code:\n%s\n", data);
+
+            debug && printf("\nv v v\n");
+
+            char source_path[512];
+            snprintf(source_path, sizeof(source_path), "%s.%s", output_path, backend->source_extension);
+            options.output_path = output_path;
+            options.source_path = saveAssembly ? source_path : NULL;
+            options.script_path = file_path;
+            // Batch and server modes already keep every core busy with whole compilations
+            options.codegen_jobs = jobs;
+
+            CompileResult result;
+            failed = compile_source(data, length, &options, &result);
+            free(data);
+            if (failed) {
+                printf("%s\n", result.error);
+            }
+        }
+        if (failed) {
+            exit_code = 1;
+        }
+
+        // Run the script and hand its exit status back to the caller
+        if (!failed && !onlyCompile) {
+            // A bare name would be searched in PATH instead of the current directory
+            char run_path[512];
+            snprintf(run_path, sizeof(run_path), "%s%s", strchr(output_path, '/') ? "" : "./", output_path);
+            char *run_argv[] = {run_path, NULL};
+            fflush(stdout);
+            stats_start(stats_pointer, &timer);
+            exit_code = process_run(run_argv);
+            stats_stop(stats_pointer, PHASE_RUN, &timer);
+            if (exit_code < 0) {
+                printf("Error running %s\n", output_path);
+                exit_code = 1;
+            }
+        }
+
+        // Reported on stderr so the program's own output stays clean
+        if (stats_pointer) {
+            stats_finish(stats_pointer);
+            if (showStats) stats_print(stats_pointer, stderr);
+            if (statsJson) stats_print_json(stats_pointer, stderr);
         }
-        system("./output");
+    }
+
+    if (options.cache) {
+        if (showCacheStats) cache_print_stats(options.cache);
+        cache_free(options.cache);
     }
 
     // Cleanup
-    codegen_free(codegen);
-    ast_node_free(ast);
-    parser_free(parser);
-    token_array_free(tokens);
-    fclose(file);
+    for (int i = 0; i < input_count; i++) {
+        free(inputs[i]);
+    }
+    free(inputs);
 
-    return 0;
+    return exit_code;
 }
@@ -0,0 +1,201 @@
+#include "pool.h"
+#include <stdlib.h>
+#include <unistd.h>
+
+static void work_queue_init(WorkQueue *queue) {
+    queue->tasks = malloc(sizeof(Task) * 16);
+    queue->head = 0;
+    queue->tail = 0;
+    queue->capacity = 16;
+    pthread_mutex_init(&queue->lock, NULL);
+}
+
+static void work_queue_free(WorkQueue *queue) {
+    free(queue->tasks);
+    pthread_mutex_destroy(&queue->lock);
+}
+
+static void work_queue_push(WorkQueue *queue, Task task) {
+    pthread_mutex_lock(&queue->lock);
+    if (queue->tail >= queue->capacity) {
+        // Compact consumed slots before growing
+        int count = queue->tail - queue->head;
+        if (queue->head > 0 && count < queue->capacity / 2) {
+            for (int i = 0; i < count; i++) {
+                queue->tasks[i] = queue->tasks[queue->head + i];
+            }
+        } else {
+            queue->capacity *= 2;
+            Task *tasks = malloc(sizeof(Task) * queue->capacity);
+            for (int i = 0; i < count; i++) {
+                tasks[i] = queue->tasks[queue->head + i];
+            }
+            free(queue->tasks);
+            queue->tasks = tasks;
+        }
+        queue->head = 0;
+        queue->tail = count;
+    }
+    queue->tasks[queue->tail++] = task;
+    pthread_mutex_unlock(&queue->lock);
+}
+
+// Owner side: newest task first, which keeps its data warm in cache
+static int work_queue_pop(WorkQueue *queue, Task *task) {
+    int found = 0;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->tail > queue->head) {
+        *task = queue->tasks[--queue->tail];
+        found = 1;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return found;
+}
+
+// Thief side: oldest task first
+static int work_queue_steal(WorkQueue *queue, Task *task) {
+    int found = 0;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->tail > queue->head) {
+        *task = queue->tasks[queue->head++];
+        found = 1;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return found;
+}
+
+typedef struct {
+    ThreadPool *pool;
+    int index;
+} WorkerArgs;
+
+static int thread_pool_take(ThreadPool *pool, int index, Task *task) {
+    if (work_queue_pop(&pool->queues[index], task)) {
+        return 1;
+    }
+    for (int i = 1; i < pool->worker_count; i++) {
+        if (work_queue_steal(&pool->queues[(index + i) % pool->worker_count], task)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void* thread_pool_worker(void *arg) {
+    WorkerArgs *args = arg;
+    ThreadPool *pool = args->pool;
+    int index = args->index;
+    free(args);
+
+    for (;;) {
+        Task task;
+        if (thread_pool_take(pool, index, &task)) {
+            atomic_fetch_sub(&pool->queued, 1);
+            task.function(task.arg);
+
+            if (atomic_fetch_sub(&pool->pending, 1) == 1) {
+                pthread_mutex_lock(&pool->lock);
+                pthread_cond_broadcast(&pool->all_done);
+                pthread_mutex_unlock(&pool->lock);
+            }
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        while (atomic_load(&pool->queued) <= 0 && !pool->shutdown) {
+            pthread_cond_wait(&pool->work_available, &pool->lock);
+        }
+        int stop = pool->shutdown && atomic_load(&pool->queued) <= 0;
+        pthread_mutex_unlock(&pool->lock);
+
+        if (stop) break;
+    }
+
+    return NULL;
+}
+
+int thread_pool_default_size(void) {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+}
+
+int thread_pool_clamp_size(int worker_count) {
+    if (worker_count < 1) return 1;
+    if (worker_count > POOL_MAX_WORKERS) return POOL_MAX_WORKERS;
+    return worker_count;
+}
+
+ThreadPool* thread_pool_create(int worker_count) {
+    worker_count = thread_pool_clamp_size(worker_count);
+
+    ThreadPool *pool = malloc(sizeof(ThreadPool));
+    pool->worker_count = worker_count;
+    pool->threads = malloc(sizeof(pthread_t) * worker_count);
+    pool->queues = malloc(sizeof(WorkQueue) * worker_count);
+    pool->next_queue = 0;
+    atomic_init(&pool->queued, 0);
+    atomic_init(&pool->pending, 0);
+    pool->shutdown = 0;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_available, NULL);
+    pthread_cond_init(&pool->all_done, NULL);
+
+    for (int i = 0; i < worker_count; i++) {
+        work_queue_init(&pool->queues[i]);
+    }
+    for (int i = 0; i < worker_count; i++) {
+        WorkerArgs *args = malloc(sizeof(WorkerArgs));
+        args->pool = pool;
+        args->index = i;
+        pthread_create(&pool->threads[i], NULL, thread_pool_worker, args);
+    }
+
+    return pool;
+}
+
+void thread_pool_submit(ThreadPool *pool, TaskFunction function, void *arg) {
+    Task task = {function, arg};
+    atomic_fetch_add(&pool->pending, 1);
+
+    pthread_mutex_lock(&pool->lock);
+    int index = pool->next_queue;
+    pool->next_queue = (pool->next_queue + 1) % pool->worker_count;
+    pthread_mutex_unlock(&pool->lock);
+
+    work_queue_push(&pool->queues[index], task);
+
+    // Publish under the lock so a worker about to sleep cannot miss it
+    pthread_mutex_lock(&pool->lock);
+    atomic_fetch_add(&pool->queued, 1);
+    pthread_cond_signal(&pool->work_available);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void thread_pool_wait(ThreadPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    while (atomic_load(&pool->pending) > 0) {
+        pthread_cond_wait(&pool->all_done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void thread_pool_free(ThreadPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->work_available);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->worker_count; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    for (int i = 0; i < pool->worker_count; i++) {
+        work_queue_free(&pool->queues[i]);
+    }
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work_available);
+    pthread_cond_destroy(&pool->all_done);
+    free(pool->queues);
+    free(pool->threads);
+    free(pool);
+}
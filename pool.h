@@ -0,0 +1,59 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+// Upper bound on workers a user can ask for with --jobs
+#define POOL_MAX_WORKERS 1024
+
+typedef void (*TaskFunction)(void *arg);
+
+// Task queued on a worker
+typedef struct {
+    TaskFunction function;
+    void *arg;
+} Task;
+
+// Per-worker deque: the owner pops from the tail, idle workers steal from the head
+typedef struct {
+    Task *tasks;
+    int head;
+    int tail;
+    int capacity;
+    pthread_mutex_t lock;
+} WorkQueue;
+
+// Fixed-size work-stealing thread pool
+typedef struct ThreadPool {
+    int worker_count;
+    pthread_t *threads;
+    WorkQueue *queues;
+    int next_queue;        // Round-robin target for submissions
+    atomic_int queued;     // Tasks waiting in any queue
+    atomic_int pending;    // Tasks submitted but not yet finished
+    int shutdown;
+    pthread_mutex_t lock;
+    pthread_cond_t work_available;
+    pthread_cond_t all_done;
+} ThreadPool;
+
+// Start a pool with worker_count threads (at least one)
+ThreadPool* thread_pool_create(int worker_count);
+
+// Queue a task. Tasks may run in any order and on any worker
+void thread_pool_submit(ThreadPool *pool, TaskFunction function, void *arg);
+
+// Block until every submitted task has finished
+void thread_pool_wait(ThreadPool *pool);
+
+// Stop the workers and free the pool. Pending tasks are finished first
+void thread_pool_free(ThreadPool *pool);
+
+// Number of online CPUs, used as the default worker count
+int thread_pool_default_size(void);
+
+// Clamp a requested worker count to 1..POOL_MAX_WORKERS
+int thread_pool_clamp_size(int worker_count);
+
+#endif // POOL_H
@@ -0,0 +1,160 @@
+#define _GNU_SOURCE
+#include "process.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+int process_wait(pid_t pid) {
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) return -1;
+    }
+    if (WIFEXITED(status)) return WEXITSTATUS(status);
+    if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+    return -1;
+}
+
+// vemora ignores SIGPIPE, and ignored signals survive exec; children get the
+// default back so a tool or program writing to a closed pipe still dies of it
+static void spawn_attributes_init(posix_spawnattr_t *attributes, short flags) {
+    sigset_t defaults;
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGPIPE);
+
+    posix_spawnattr_init(attributes);
+    posix_spawnattr_setsigdefault(attributes, &defaults);
+    posix_spawnattr_setflags(attributes, flags | POSIX_SPAWN_SETSIGDEF);
+}
+
+int process_run(char *const argv[]) {
+    posix_spawnattr_t attributes;
+    spawn_attributes_init(&attributes, 0);
+
+    pid_t pid;
+    int result = posix_spawnp(&pid, argv[0], NULL, &attributes, argv, environ);
+    posix_spawnattr_destroy(&attributes);
+    if (result != 0) {
+        return -1;
+    }
+    return process_wait(pid);
+}
+
+int process_run_capture(char *const argv[], char **output, size_t *length) {
+    *output = NULL;
+    *length = 0;
+
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+        return -1;
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDERR_FILENO);
+
+    posix_spawnattr_t attributes;
+    spawn_attributes_init(&attributes, 0);
+
+    pid_t pid;
+    int result = posix_spawnp(&pid, argv[0], &actions, &attributes, argv, environ);
+    posix_spawnattr_destroy(&attributes);
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[1]);
+
+    if (result != 0) {
+        close(fds[0]);
+        return -1;
+    }
+
+    size_t capacity = 4096;
+    char *buffer = malloc(capacity);
+    ssize_t n;
+    for (;;) {
+        if (*length == capacity) {
+            capacity *= 2;
+            buffer = realloc(buffer, capacity);
+        }
+        n = read(fds[0], buffer + *length, capacity - *length);
+        if (n > 0) {
+            *length += n;
+        } else if (n == 0 || errno != EINTR) {
+            break;
+        }
+    }
+    close(fds[0]);
+
+    *output = buffer;
+    return process_wait(pid);
+}
+
+FILE* process_spawn_writer(char *const argv[], pid_t *pid) {
+    // Close-on-exec so concurrent spawns never inherit each other's pipe ends
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+        return NULL;
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[0], STDIN_FILENO);
+
+    // Own process group, so process_kill_group also reaches the tool's children
+    posix_spawnattr_t attributes;
+    spawn_attributes_init(&attributes, POSIX_SPAWN_SETPGROUP);
+    posix_spawnattr_setpgroup(&attributes, 0);
+
+    int result = posix_spawnp(pid, argv[0], &actions, &attributes, argv, environ);
+    posix_spawnattr_destroy(&attributes);
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[0]);
+
+    if (result != 0) {
+        close(fds[1]);
+        return NULL;
+    }
+
+    FILE *stream = fdopen(fds[1], "w");
+    if (stream == NULL) {
+        close(fds[1]);
+        process_wait(*pid);
+        return NULL;
+    }
+    return stream;
+}
+
+void process_kill_group(pid_t pid) {
+    kill(-pid, SIGKILL);
+    process_wait(pid);
+}
+
+FILE* temp_file_create(char *path, size_t size) {
+    const char *dir = getenv("TMPDIR");
+    if (dir == NULL || dir[0] == '\0') {
+        dir = "/tmp";
+    }
+
+    if ((size_t)snprintf(path, size, "%s/vemora-XXXXXX", dir) >= size) {
+        return NULL;
+    }
+
+    int fd = mkostemp(path, O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    FILE *file = fdopen(fd, "w");
+    if (file == NULL) {
+        close(fd);
+        unlink(path);
+        return NULL;
+    }
+    return file;
+}
@@ -0,0 +1,30 @@
+#ifndef PROCESS_H
+#define PROCESS_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+// Spawn argv[0] (searched in PATH) and wait for it.
+// Returns its exit status, 128 + signal if it was killed, or -1 if it could not be started
+int process_run(char *const argv[]);
+
+// Spawn argv[0] with stdout and stderr captured into a malloc'd buffer (*output, *length).
+// Same return convention as process_run
+int process_run_capture(char *const argv[], char **output, size_t *length);
+
+// Spawn argv[0] with its stdin connected to a pipe.
+// Returns the write end of the pipe and stores the child in *pid, or NULL on failure
+FILE* process_spawn_writer(char *const argv[], pid_t *pid);
+
+// Kill a child started by process_spawn_writer together with everything it spawned, and reap it
+void process_kill_group(pid_t pid);
+
+// Wait for a spawned child. Same return convention as process_run
+int process_wait(pid_t pid);
+
+// Create a private temporary file under $TMPDIR (or /tmp) and write its path to path.
+// Returns the file opened for writing, or NULL on failure
+FILE* temp_file_create(char *path, size_t size);
+
+#endif // PROCESS_H
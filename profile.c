@@ -0,0 +1,165 @@
+#include "profile.h"
+#include "codegen.h"
+#include "compiler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+typedef struct {
+    long index;
+    uint64_t line;
+    uint64_t cycles;
+    uint64_t hits;
+} ProfileEntry;
+
+// Text of each source line, whitespace collapsed so it fits on one row
+typedef struct {
+    char **lines;
+    int count;
+} ProfileSource;
+
+static int profile_load_source(const char *path, ProfileSource *source) {
+    char *data = read_file(path, NULL);
+    if (data == NULL) {
+        return 1;
+    }
+
+    int capacity = 64;
+    source->lines = malloc(sizeof(char *) * capacity);
+    source->count = 0;
+    for (const char *p = data; *p; ) {
+        if (source->count == capacity) {
+            capacity *= 2;
+            source->lines = realloc(source->lines, sizeof(char *) * capacity);
+        }
+        char *text = malloc(64);
+        size_t length = 0;
+        int space = 0;
+        for (; *p && *p != '\n'; p++) {
+            if (isspace((unsigned char)*p)) {
+                space = length > 0;
+            } else {
+                if (space && length + 1 < 64) text[length++] = ' ';
+                if (length + 1 < 64) text[length++] = *p;
+                space = 0;
+            }
+        }
+        text[length] = '\0';
+        source->lines[source->count++] = text;
+        if (*p == '\n') p++;
+    }
+
+    free(data);
+    return 0;
+}
+
+static void profile_free_source(ProfileSource *source) {
+    for (int i = 0; i < source->count; i++) {
+        free(source->lines[i]);
+    }
+    free(source->lines);
+}
+
+static int compare_entries(const void *a, const void *b) {
+    const ProfileEntry *x = a;
+    const ProfileEntry *y = b;
+    if (x->cycles != y->cycles) return x->cycles < y->cycles ? 1 : -1;
+    return (x->index > y->index) - (x->index < y->index);
+}
+
+int profile_report(const char *profile_path, const char *source_path, int limit) {
+    FILE *file = fopen(profile_path, "rb");
+    if (file == NULL) {
+        printf("Error opening profile %s\n", profile_path);
+        return 1;
+    }
+
+    char magic[8];
+    uint64_t count;
+    uint64_t script_length;
+    if (fread(magic, 1, 8, file) != 8 || memcmp(magic, PROFILE_MAGIC, 8) != 0 ||
+        fread(&count, sizeof(count), 1, file) != 1 ||
+        fread(&script_length, sizeof(script_length), 1, file) != 1 || script_length >= PATH_MAX) {
+        printf("Not a vemora profile: %s\n", profile_path);
+        fclose(file);
+        return 1;
+    }
+
+    // The script path is padded to 8 bytes. Every statement then takes a
+    // line and two counters, so the file size bounds a sane count
+    char script[PATH_MAX + 8];
+    size_t padded = (script_length + 7) / 8 * 8;
+    struct stat st;
+    uint64_t header = 24 + padded;
+    if (fstat(fileno(file), &st) != 0 || (uint64_t)st.st_size < header ||
+        count > ((uint64_t)st.st_size - header) / (3 * sizeof(uint64_t))) {
+        printf("Truncated profile: %s\n", profile_path);
+        fclose(file);
+        return 1;
+    }
+
+    ProfileEntry *entries = malloc(sizeof(ProfileEntry) * (count > 0 ? count : 1));
+    if (entries == NULL) {
+        printf("Profile too large: %s\n", profile_path);
+        fclose(file);
+        return 1;
+    }
+    int truncated = fread(script, 1, padded, file) != padded;
+    script[script_length] = '\0';
+    for (uint64_t i = 0; i < count && !truncated; i++) {
+        uint64_t line;
+        if (fread(&line, sizeof(line), 1, file) != 1) {
+            truncated = 1;
+            break;
+        }
+        entries[i].index = i;
+        entries[i].line = line;
+    }
+    uint64_t total = 0;
+    for (uint64_t i = 0; i < count && !truncated; i++) {
+        uint64_t counters[2];
+        if (fread(counters, sizeof(uint64_t), 2, file) != 2) {
+            truncated = 1;
+            break;
+        }
+        entries[i].cycles = counters[0];
+        entries[i].hits = counters[1];
+        total += counters[0];
+    }
+    fclose(file);
+    if (truncated) {
+        printf("Truncated profile: %s\n", profile_path);
+        free(entries);
+        return 1;
+    }
+
+    // Show the text of the script the profile names, unless told otherwise
+    if (source_path == NULL && script_length > 0) {
+        source_path = script;
+    }
+    ProfileSource source = {0};
+    if (source_path && profile_load_source(source_path, &source) != 0) {
+        printf("Error opening file %s\n", source_path);
+    }
+
+    qsort(entries, count, sizeof(ProfileEntry), compare_entries);
+
+    printf("%llu statements, %llu cycles\n", (unsigned long long)count, (unsigned long long)total);
+    printf("%5s %6s %6s %14s %7s %8s  %s\n", "rank", "stmt", "line", "cycles", "%", "hits", "source");
+    for (uint64_t i = 0; i < count && (limit <= 0 || i < (uint64_t)limit); i++) {
+        ProfileEntry *entry = &entries[i];
+        double percent = total ? 100.0 * entry->cycles / total : 0.0;
+        const char *text = entry->line >= 1 && entry->line <= (uint64_t)source.count ? source.lines[entry->line - 1] : "";
+        printf("%5llu %6ld %6llu %14llu %6.1f%% %8llu  %s\n", (unsigned long long)i + 1, entry->index,
+               (unsigned long long)entry->line, (unsigned long long)entry->cycles, percent,
+               (unsigned long long)entry->hits, text);
+    }
+
+    profile_free_source(&source);
+    free(entries);
+    return 0;
+}
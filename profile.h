@@ -0,0 +1,10 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+// Print the `limit` statements with the most cycles from a profile written by
+// a --profile build (see PROFILE_FILE). Each row shows the statement's line,
+// and its text from source_path, or from the script the profile names when
+// source_path is NULL. Returns 0 on success
+int profile_report(const char *profile_path, const char *source_path, int limit);
+
+#endif // PROFILE_H
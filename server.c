@@ -0,0 +1,475 @@
+#define _GNU_SOURCE
+#include "server.h"
+#include "pool.h"
+#include "process.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define SERVER_MAX_SOURCE (256u * 1024 * 1024)
+
+static char server_socket_path[sizeof(((struct sockaddr_un*)0)->sun_path)];
+static char server_work_dir[256];
+static atomic_int server_next_id;
+
+// Connections handed back by workers after answering a request, for the
+// accept loop to poll again. A byte on the pipe wakes the loop up
+static struct {
+    pthread_mutex_t lock;
+    int *fds;
+    int count;
+    int capacity;
+    int wake[2];
+} server_ready = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+static double elapsed_ms(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e3 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+static void deadline_after(struct timespec *deadline, int ms) {
+    clock_gettime(CLOCK_MONOTONIC, deadline);
+    deadline->tv_sec += ms / 1000;
+    deadline->tv_nsec += (long)(ms % 1000) * 1000000;
+    if (deadline->tv_nsec >= 1000000000) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000;
+    }
+}
+
+// Wait until fd is ready for events or the deadline (NULL: never) passes.
+// Returns 0 when ready
+static int wait_ready(int fd, short events, const struct timespec *deadline) {
+    for (;;) {
+        int timeout = -1;
+        if (deadline) {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            double remaining = (deadline->tv_sec - now.tv_sec) * 1e3 + (deadline->tv_nsec - now.tv_nsec) / 1e6;
+            if (remaining <= 0) return -1;
+            timeout = (int)remaining + 1;
+        }
+
+        struct pollfd poll_fd = {.fd = fd, .events = events};
+        int ready = poll(&poll_fd, 1, timeout);
+        if (ready > 0) return 0;
+        if (ready == 0) return -1;
+        if (errno != EINTR) return -1;
+    }
+}
+
+static int read_full(int fd, void *buffer, size_t size, const struct timespec *deadline) {
+    char *p = buffer;
+    while (size > 0) {
+        ssize_t n = read(fd, p, size);
+        if (n == 0) return -1;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) && wait_ready(fd, POLLIN, deadline) == 0) continue;
+            return -1;
+        }
+        p += n;
+        size -= n;
+    }
+    return 0;
+}
+
+static int write_full(int fd, const void *buffer, size_t size, const struct timespec *deadline) {
+    const char *p = buffer;
+    while (size > 0) {
+        ssize_t n = write(fd, p, size);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) && wait_ready(fd, POLLOUT, deadline) == 0) continue;
+            return -1;
+        }
+        p += n;
+        size -= n;
+    }
+    return 0;
+}
+
+static uint32_t get_u32(const unsigned char *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void put_u32(unsigned char *p, uint32_t value) {
+    p[0] = value >> 24;
+    p[1] = value >> 16;
+    p[2] = value >> 8;
+    p[3] = value;
+}
+
+static int send_response(int fd, ServerStatus status, uint32_t latency_us,
+                         const char *payload, size_t length) {
+    // A client that stops reading cannot keep the worker either
+    struct timespec deadline;
+    deadline_after(&deadline, SERVER_REQUEST_TIMEOUT_MS);
+
+    unsigned char header[9];
+    header[0] = status;
+    put_u32(header + 1, latency_us);
+    put_u32(header + 5, length);
+    if (write_full(fd, header, sizeof(header), &deadline) != 0) return -1;
+    return write_full(fd, payload, length, &deadline);
+}
+
+static const Backend* server_backend(char code) {
+    switch (code) {
+        case 'a': return &backend_nasm;
+        case 'c': return &backend_c;
+        default: return NULL;
+    }
+}
+
+// Run one request. The payload is malloc'd, or points into result->error
+static ServerStatus server_handle(const CompileOptions *base, ServerCommand command, const Backend *backend,
+                                  const char *data, size_t length, CompileResult *result,
+                                  char **payload, size_t *payload_length) {
+    CompileOptions options = *base;
+    options.backend = backend;
+    options.source_path = NULL;
+    options.debug = false;
+
+    *payload = NULL;
+    *payload_length = 0;
+    result->status = 0;
+    result->error[0] = '\0';
+
+    if (command == SERVER_GENERATE) {
+        FILE *output = open_memstream(payload, payload_length);
+        generate_source(data, &options, output, result);
+        fclose(output);
+        if (result->status != 0) {
+            free(*payload);
+            *payload = NULL;
+        }
+    } else if (command == SERVER_BUILD || command == SERVER_RUN) {
+        char output_path[320];
+        snprintf(output_path, sizeof(output_path), "%s/prog-%d",
+                 server_work_dir, atomic_fetch_add(&server_next_id, 1));
+        options.output_path = output_path;
+        // Each program profiles next to its executable, never to a shared path
+        options.profile_path = NULL;
+
+        if (compile_source(data, length, &options, result) == 0) {
+            if (command == SERVER_BUILD) {
+                *payload = strdup(output_path);
+                *payload_length = strlen(output_path);
+            } else {
+                char *run_argv[] = {output_path, NULL};
+                int exit_code = process_run_capture(run_argv, payload, payload_length);
+                unlink(output_path);
+                if (options.profile) {
+                    // Only the output goes back to the client
+                    char profile_path[PATH_MAX + 8];
+                    unlink(compile_profile_path(&options, profile_path, sizeof(profile_path)));
+                }
+                if (exit_code != 0) return SERVER_RUN_FAILED;
+            }
+        }
+    } else {
+        return SERVER_BAD_REQUEST;
+    }
+
+    if (result->status != 0) {
+        *payload_length = strlen(result->error);
+        return SERVER_COMPILE_ERROR;
+    }
+    return SERVER_OK;
+}
+
+typedef struct {
+    int fd;
+    const CompileOptions *base;
+} Connection;
+
+// Answer the one request waiting on fd. Returns 0 if the connection stays open
+static int server_serve_request(int fd, const CompileOptions *base) {
+    struct timespec start, deadline;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    deadline_after(&deadline, SERVER_REQUEST_TIMEOUT_MS);
+
+    // The loop only schedules readable connections, so EOF here is a clean close
+    unsigned char header[6];
+    if (read_full(fd, header, sizeof(header), &deadline) != 0) {
+        return -1;
+    }
+
+    ServerCommand command = header[0];
+    const Backend *backend = server_backend(header[1]);
+    uint32_t length = get_u32(header + 2);
+    if (backend == NULL || length > SERVER_MAX_SOURCE) {
+        const char *message = "Bad request";
+        send_response(fd, SERVER_BAD_REQUEST, 0, message, strlen(message));
+        return -1;
+    }
+
+    char *data = malloc(length + 1);
+    if (read_full(fd, data, length, &deadline) != 0) {
+        free(data);
+        return -1;
+    }
+    data[length] = '\0';
+
+    CompileResult result;
+    char *payload;
+    size_t payload_length;
+    ServerStatus status = server_handle(base, command, backend, data, length,
+                                        &result, &payload, &payload_length);
+    free(data);
+
+    double latency = elapsed_ms(&start);
+    fprintf(stderr, "[serve] %c %s %u bytes -> status %d in %.3f ms\n",
+            command, backend->name, length, status, latency);
+
+    int sent = send_response(fd, status, (uint32_t)(latency * 1000),
+                             payload ? payload : result.error, payload_length);
+    free(payload);
+    return sent;
+}
+
+// Pool task: one request, then the connection goes back to the accept loop
+static void server_connection(void *arg) {
+    Connection *connection = arg;
+    int fd = connection->fd;
+
+    if (server_serve_request(fd, connection->base) != 0) {
+        close(fd);
+    } else {
+        pthread_mutex_lock(&server_ready.lock);
+        if (server_ready.count >= server_ready.capacity) {
+            server_ready.capacity = server_ready.capacity ? server_ready.capacity * 2 : 16;
+            server_ready.fds = realloc(server_ready.fds, sizeof(int) * server_ready.capacity);
+        }
+        server_ready.fds[server_ready.count++] = fd;
+        pthread_mutex_unlock(&server_ready.lock);
+
+        char byte = 0;
+        while (write(server_ready.wake[1], &byte, 1) < 0 && errno == EINTR) {}
+    }
+    free(connection);
+}
+
+typedef struct {
+    struct pollfd *fds;
+    int count;
+    int capacity;
+} PollSet;
+
+static void poll_set_add(PollSet *set, int fd) {
+    if (set->count >= set->capacity) {
+        set->capacity = set->capacity ? set->capacity * 2 : 16;
+        set->fds = realloc(set->fds, sizeof(struct pollfd) * set->capacity);
+    }
+    set->fds[set->count].fd = fd;
+    set->fds[set->count].events = POLLIN;
+    set->fds[set->count].revents = 0;
+    set->count++;
+}
+
+static volatile sig_atomic_t server_stopping;
+
+// The first SIGINT/SIGTERM asks the accept loop to stop after the requests in
+// progress; a second one leaves at once
+static void server_shutdown(int signal_number) {
+    (void)signal_number;
+    if (server_stopping) {
+        unlink(server_socket_path);
+        _exit(1);
+    }
+    server_stopping = 1;
+    char byte = 0;
+    if (write(server_ready.wake[1], &byte, 1) < 0) {}
+}
+
+// Executables handed out by build requests live here until the server stops
+static void server_remove_work_dir(void) {
+    DIR *dir = opendir(server_work_dir);
+    if (dir) {
+        struct dirent *dirent;
+        while ((dirent = readdir(dir)) != NULL) {
+            if (strcmp(dirent->d_name, ".") == 0 || strcmp(dirent->d_name, "..") == 0) continue;
+            unlinkat(dirfd(dir), dirent->d_name, 0);
+        }
+        closedir(dir);
+    }
+    rmdir(server_work_dir);
+}
+
+int server_run(const char *socket_path, const CompileOptions *base, int jobs) {
+    struct sockaddr_un address = {0};
+    address.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        printf("Socket path too long: %s\n", socket_path);
+        return 1;
+    }
+    strcpy(address.sun_path, socket_path);
+    strcpy(server_socket_path, socket_path);
+
+    const char *tmp = getenv("TMPDIR");
+    snprintf(server_work_dir, sizeof(server_work_dir), "%s/vemora-serve-XXXXXX",
+             tmp && tmp[0] ? tmp : "/tmp");
+    if (mkdtemp(server_work_dir) == NULL) {
+        printf("Error creating server directory\n");
+        return 1;
+    }
+
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    unlink(socket_path);
+    if (listener < 0 || bind(listener, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+        listen(listener, 128) != 0) {
+        printf("Error listening on %s\n", socket_path);
+        rmdir(server_work_dir);
+        return 1;
+    }
+    if (pipe2(server_ready.wake, O_CLOEXEC | O_NONBLOCK) != 0) {
+        printf("Error creating server pipe\n");
+        close(listener);
+        unlink(socket_path);
+        rmdir(server_work_dir);
+        return 1;
+    }
+
+    signal(SIGINT, server_shutdown);
+    signal(SIGTERM, server_shutdown);
+    fprintf(stderr, "[serve] listening on %s with %d workers\n", socket_path, jobs);
+
+    // Backends, the cache handle and the worker threads stay warm across requests.
+    // This thread polls the listener and every idle connection; a connection
+    // with a request waiting leaves the set and becomes one pool task
+    ThreadPool *pool = thread_pool_create(jobs);
+    PollSet set = {0};
+    poll_set_add(&set, listener);
+    poll_set_add(&set, server_ready.wake[0]);
+
+    while (!server_stopping) {
+        if (poll(set.fds, set.count, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (server_stopping) break;
+
+        int failed = 0;
+        int accept_ready = set.fds[0].revents != 0;
+        int wake_ready = set.fds[1].revents != 0;
+
+        // Dispatch readable connections, keeping the idle ones in place
+        int kept = 2;
+        for (int i = 2; i < set.count; i++) {
+            if (set.fds[i].revents == 0) {
+                set.fds[kept++] = set.fds[i];
+                continue;
+            }
+            Connection *connection = malloc(sizeof(Connection));
+            connection->fd = set.fds[i].fd;
+            connection->base = base;
+            thread_pool_submit(pool, server_connection, connection);
+        }
+        set.count = kept;
+
+        if (wake_ready) {
+            char buffer[64];
+            while (read(server_ready.wake[0], buffer, sizeof(buffer)) > 0) {}
+
+            pthread_mutex_lock(&server_ready.lock);
+            for (int i = 0; i < server_ready.count; i++) {
+                poll_set_add(&set, server_ready.fds[i]);
+            }
+            server_ready.count = 0;
+            pthread_mutex_unlock(&server_ready.lock);
+        }
+
+        while (accept_ready) {
+            int fd = accept4(listener, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK) failed = 1;
+                break;
+            }
+            poll_set_add(&set, fd);
+        }
+        if (failed) break;
+    }
+
+    thread_pool_wait(pool);
+    thread_pool_free(pool);
+    for (int i = 2; i < set.count; i++) {
+        close(set.fds[i].fd);
+    }
+    for (int i = 0; i < server_ready.count; i++) {
+        close(server_ready.fds[i]);
+    }
+    free(server_ready.fds);
+    free(set.fds);
+    close(server_ready.wake[0]);
+    close(server_ready.wake[1]);
+    close(listener);
+    unlink(socket_path);
+    server_remove_work_dir();
+    return server_stopping ? 0 : 1;
+}
+
+int server_request(const char *socket_path, ServerCommand command, const Backend *backend,
+                   const char *data, size_t length) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    struct sockaddr_un address = {0};
+    address.sun_family = AF_UNIX;
+    snprintf(address.sun_path, sizeof(address.sun_path), "%s", socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        printf("Error connecting to %s\n", socket_path);
+        if (fd >= 0) close(fd);
+        return 1;
+    }
+
+    unsigned char header[9];
+    header[0] = command;
+    header[1] = backend == &backend_c ? 'c' : 'a';
+    put_u32(header + 2, length);
+    if (write_full(fd, header, 6, NULL) != 0 || write_full(fd, data, length, NULL) != 0 ||
+        read_full(fd, header, sizeof(header), NULL) != 0) {
+        printf("Error talking to %s\n", socket_path);
+        close(fd);
+        return 1;
+    }
+
+    ServerStatus status = header[0];
+    uint32_t latency_us = get_u32(header + 1);
+    uint32_t payload_length = get_u32(header + 5);
+    char *payload = malloc(payload_length + 1);
+    int failed = read_full(fd, payload, payload_length, NULL);
+    close(fd);
+    if (failed) {
+        printf("Error talking to %s\n", socket_path);
+        free(payload);
+        return 1;
+    }
+
+    fwrite(payload, 1, payload_length, stdout);
+    if (status == SERVER_COMPILE_ERROR || status == SERVER_BAD_REQUEST ||
+        (command == SERVER_BUILD && status == SERVER_OK)) {
+        printf("\n");
+    }
+    fflush(stdout);
+    fprintf(stderr, "Server latency: %.3f ms, round trip: %.3f ms\n",
+            latency_us / 1000.0, elapsed_ms(&start));
+
+    free(payload);
+    return status == SERVER_OK ? 0 : 1;
+}
@@ -0,0 +1,44 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "compiler.h"
+
+// Compile-server protocol over a Unix domain socket. Integers are big-endian.
+//
+// Request:  u8 command, u8 backend ('a' = asm, 'c' = C), u32 length, source bytes
+// Response: u8 status, u32 latency in microseconds, u32 length, payload bytes
+//
+// A connection may carry any number of requests; the server answers them in order
+// Time a client has to deliver a whole request, or to take a whole response
+#define SERVER_REQUEST_TIMEOUT_MS 10000
+
+typedef enum {
+    SERVER_GENERATE = 'G',  // Payload: generated target source
+    SERVER_BUILD = 'B',     // Payload: path of the built executable, owned by the client
+    SERVER_RUN = 'R'        // Payload: stdout and stderr of the program
+} ServerCommand;
+
+typedef enum {
+    SERVER_OK = 0,
+    SERVER_COMPILE_ERROR = 1,  // Payload: the error message
+    SERVER_RUN_FAILED = 2,     // Program exited non-zero. Payload: its output
+    SERVER_BAD_REQUEST = 3
+} ServerStatus;
+
+// Listen on socket_path and serve requests from any number of connections,
+// up to `jobs` of them at a time, until terminated. Idle connections hold no
+// worker; a request that is not fully received within
+// SERVER_REQUEST_TIMEOUT_MS closes its connection. SIGINT or SIGTERM stops
+// the server once requests in progress finish (a second signal exits at once),
+// deleting the executables it built. Returns 0 after such a stop, non-zero if
+// the socket cannot be set up or accepting fails
+int server_run(const char *socket_path, const CompileOptions *base, int jobs);
+
+// Send one request to a running server, print the payload and the latency.
+// Returns 0 if the server answered SERVER_OK
+int server_request(const char *socket_path, ServerCommand command, const Backend *backend,
+                   const char *data, size_t length);
+
+#endif // SERVER_H
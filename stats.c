@@ -0,0 +1,155 @@
+#include "stats.h"
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include <stdatomic.h>
+#include <sys/resource.h>
+
+static const char *phase_names[PHASE_COUNT] = {
+    "read", "tokenize", "parse", "codegen", "assemble", "link", "run"
+};
+
+static atomic_llong allocation_count;
+static atomic_llong allocation_bytes;
+
+static void count_allocation(size_t size) {
+    atomic_fetch_add_explicit(&allocation_count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&allocation_bytes, size, memory_order_relaxed);
+}
+
+void* stats_malloc(size_t size) {
+    count_allocation(size);
+    return malloc(size);
+}
+
+void* stats_calloc(size_t count, size_t size) {
+    count_allocation(count * size);
+    return calloc(count, size);
+}
+
+void* stats_realloc(void *pointer, size_t size) {
+    count_allocation(size);
+    return realloc(pointer, size);
+}
+
+char* stats_strdup(const char *string) {
+    count_allocation(strlen(string) + 1);
+    return strdup(string);
+}
+
+// Bytes the allocator has handed out and not yet got back, over all arenas
+static size_t heap_in_use(void) {
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+#else
+    return 0;
+#endif
+}
+
+static void sample_heap(CompileStats *stats) {
+    size_t bytes = heap_in_use();
+    if (bytes > stats->heap_at_phase_end) stats->heap_at_phase_end = bytes;
+}
+
+void stats_init(CompileStats *stats) {
+    memset(stats, 0, sizeof(CompileStats));
+    // Start from the current totals; stats_finish adds the final ones
+    stats->allocations = -atomic_load(&allocation_count);
+    stats->allocated_bytes = -atomic_load(&allocation_bytes);
+}
+
+static double timespec_ms(const struct timespec *end, const struct timespec *start) {
+    return (end->tv_sec - start->tv_sec) * 1e3 + (end->tv_nsec - start->tv_nsec) / 1e6;
+}
+
+static double timeval_ms(const struct timeval *end, const struct timeval *start) {
+    return (end->tv_sec - start->tv_sec) * 1e3 + (end->tv_usec - start->tv_usec) / 1e3;
+}
+
+static void children_cpu(struct timeval *total) {
+    struct rusage usage;
+    getrusage(RUSAGE_CHILDREN, &usage);
+    timeradd(&usage.ru_utime, &usage.ru_stime, total);
+}
+
+static void stats_start_clock(CompileStats *stats, StatsTimer *timer, clockid_t clock) {
+    if (stats == NULL) return;
+    sample_heap(stats);
+    timer->clock = clock;
+    clock_gettime(CLOCK_MONOTONIC, &timer->wall);
+    clock_gettime(clock, &timer->cpu);
+    children_cpu(&timer->children);
+}
+
+void stats_start(CompileStats *stats, StatsTimer *timer) {
+    stats_start_clock(stats, timer, CLOCK_THREAD_CPUTIME_ID);
+}
+
+void stats_start_process(CompileStats *stats, StatsTimer *timer) {
+    stats_start_clock(stats, timer, CLOCK_PROCESS_CPUTIME_ID);
+}
+
+void stats_stop(CompileStats *stats, StatsPhase phase, StatsTimer *timer) {
+    if (stats == NULL) return;
+
+    struct timespec wall, cpu;
+    struct timeval children;
+    clock_gettime(CLOCK_MONOTONIC, &wall);
+    clock_gettime(timer->clock, &cpu);
+    children_cpu(&children);
+
+    stats->wall_ms[phase] += timespec_ms(&wall, &timer->wall);
+    stats->cpu_ms[phase] += timespec_ms(&cpu, &timer->cpu) + timeval_ms(&children, &timer->children);
+    stats->ran[phase] = true;
+    sample_heap(stats);
+}
+
+void stats_finish(CompileStats *stats) {
+    sample_heap(stats);
+    stats->allocations += atomic_load(&allocation_count);
+    stats->allocated_bytes += atomic_load(&allocation_bytes);
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    stats->peak_rss_kb = usage.ru_maxrss;
+}
+
+void stats_print(const CompileStats *stats, FILE *output) {
+    fprintf(output, "\n%-10s %12s %12s\n", "phase", "wall ms", "cpu ms");
+    double wall = 0;
+    double cpu = 0;
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        if (!stats->ran[i]) continue;
+        fprintf(output, "%-10s %12.3f %12.3f\n", phase_names[i], stats->wall_ms[i], stats->cpu_ms[i]);
+        wall += stats->wall_ms[i];
+        cpu += stats->cpu_ms[i];
+    }
+    fprintf(output, "%-10s %12.3f %12.3f\n", "total", wall, cpu);
+
+    if (stats->cached) {
+        fprintf(output, "cache hit: compilation skipped\n");
+    } else {
+        fprintf(output, "tokens %ld, AST nodes %ld, symbols %ld, instructions %ld, output %zu bytes\n",
+                stats->tokens, stats->nodes, stats->symbols, stats->instructions, stats->output_bytes);
+    }
+    fprintf(output, "allocations %lld (%lld bytes), heap at phase end %zu KB, peak RSS %ld KB\n",
+            stats->allocations, stats->allocated_bytes, stats->heap_at_phase_end / 1024, stats->peak_rss_kb);
+}
+
+void stats_print_json(const CompileStats *stats, FILE *output) {
+    fprintf(output, "{\"phases\":{");
+    int first = 1;
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        if (!stats->ran[i]) continue;
+        fprintf(output, "%s\"%s\":{\"wall_ms\":%.3f,\"cpu_ms\":%.3f}",
+                first ? "" : ",", phase_names[i], stats->wall_ms[i], stats->cpu_ms[i]);
+        first = 0;
+    }
+    fprintf(output, "},\"cached\":%s,\"tokens\":%ld,\"nodes\":%ld,\"symbols\":%ld,"
+            "\"instructions\":%ld,\"output_bytes\":%zu,\"allocations\":%lld,\"allocated_bytes\":%lld,"
+            "\"heap_at_phase_end\":%zu,\"peak_rss_kb\":%ld}\n",
+            stats->cached ? "true" : "false", stats->tokens, stats->nodes, stats->symbols,
+            stats->instructions, stats->output_bytes, stats->allocations,
+            stats->allocated_bytes, stats->heap_at_phase_end, stats->peak_rss_kb);
+}
@@ -0,0 +1,69 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <time.h>
+#include <sys/time.h>
+
+// Pipeline phases that are timed separately
+typedef enum {
+    PHASE_READ,
+    PHASE_TOKENIZE,
+    PHASE_PARSE,
+    PHASE_CODEGEN,
+    PHASE_ASSEMBLE,
+    PHASE_LINK,
+    PHASE_RUN,
+    PHASE_COUNT
+} StatsPhase;
+
+// Start of a timed phase
+typedef struct {
+    struct timespec wall;
+    struct timespec cpu;
+    clockid_t clock;          // CPU clock the phase is charged to
+    struct timeval children;  // CPU time of reaped child processes (nasm, ld, cc, the program)
+} StatsTimer;
+
+// Instrumentation for one compilation. Every recording function accepts a
+// NULL stats pointer and does nothing, so the cost with --stats off is one branch
+typedef struct {
+    double wall_ms[PHASE_COUNT];
+    double cpu_ms[PHASE_COUNT];
+    bool ran[PHASE_COUNT];
+    bool cached;
+    long tokens;
+    long nodes;
+    long symbols;
+    long instructions;        // NASM instructions, or C statements for the C backend
+    size_t output_bytes;      // Generated target source
+    long long allocations;    // Pipeline allocations (see stats_malloc) since stats_init
+    long long allocated_bytes;
+    size_t heap_at_phase_end; // Largest heap in use at a phase boundary; spikes inside a phase are missed (glibc only)
+    long peak_rss_kb;
+} CompileStats;
+
+// The tokenizer, parser, code generator and emitter allocate through these,
+// so their allocations are counted (one relaxed atomic add each). Memory is
+// released with plain free
+void* stats_malloc(size_t size);
+void* stats_calloc(size_t count, size_t size);
+void* stats_realloc(void *pointer, size_t size);
+char* stats_strdup(const char *string);
+
+void stats_init(CompileStats *stats);
+void stats_start(CompileStats *stats, StatsTimer *timer);
+
+// Like stats_start, but charge the whole process's CPU time to the phase,
+// for phases that fan work out to other threads
+void stats_start_process(CompileStats *stats, StatsTimer *timer);
+void stats_stop(CompileStats *stats, StatsPhase phase, StatsTimer *timer);
+
+// Capture allocation counts, the final heap size and peak RSS
+void stats_finish(CompileStats *stats);
+
+void stats_print(const CompileStats *stats, FILE *output);
+void stats_print_json(const CompileStats *stats, FILE *output);
+
+#endif // STATS_H
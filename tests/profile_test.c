@@ -0,0 +1,66 @@
+// profile_report on corrupt profiles: a count that the file cannot hold must
+// be rejected before anything is allocated or read
+#include "../profile.h"
+#include "../codegen.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+static int failures = 0;
+
+// Magic, count and a script path of "s.vm", then `statements` full records
+static void write_profile(const char *path, uint64_t count, int statements) {
+    FILE *file = fopen(path, "wb");
+    uint64_t script_length = 4;
+    fwrite(PROFILE_MAGIC, 1, 8, file);
+    fwrite(&count, sizeof(count), 1, file);
+    fwrite(&script_length, sizeof(script_length), 1, file);
+    fwrite("s.vm\0\0\0\0", 1, 8, file);
+    for (int i = 0; i < statements; i++) {
+        uint64_t line = i + 1;
+        fwrite(&line, sizeof(line), 1, file);
+    }
+    for (int i = 0; i < statements; i++) {
+        uint64_t counters[2] = {100 * (i + 1), 1};
+        fwrite(counters, sizeof(uint64_t), 2, file);
+    }
+    fclose(file);
+}
+
+static void expect_report(const char *name, const char *path, int status) {
+    fflush(stdout);
+    int result = profile_report(path, NULL, 20);
+    if (result != status) {
+        printf("FAILED %s: expected status %d, got %d\n", name, status, result);
+        failures++;
+    } else {
+        printf("ok     %s\n", name);
+    }
+}
+
+int main(void) {
+    char path[] = "/tmp/vemora-profile-test-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+
+    write_profile(path, 3, 3);
+    expect_report("valid profile", path, 0);
+
+    write_profile(path, UINT64_MAX / 8, 3);
+    expect_report("count overflowing the allocation", path, 1);
+
+    write_profile(path, 1000000, 3);
+    expect_report("count larger than the file", path, 1);
+
+    write_profile(path, 3, 2);
+    expect_report("truncated counters", path, 1);
+
+    unlink(path);
+    return failures ? 1 : 0;
+}
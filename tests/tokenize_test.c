@@ -0,0 +1,83 @@
+// Tokenizer and parser behaviour on hostile input: overlong tokens must be
+// reported as errors with a position instead of overflowing fixed buffers
+#include "../token.h"
+#include "../ast.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int failures = 0;
+
+static void expect_error(const char *name, const char *source, const char *message) {
+    TokenArray *tokens = tokenize(source);
+    Parser *parser = parser_create(tokens);
+    ASTNode *program = parse_program(parser);
+
+    if (!parser->had_error || strstr(parser->error, message) == NULL) {
+        printf("FAILED %s: expected \"%s\", got \"%s\"\n", name, message,
+               parser->had_error ? parser->error : "no error");
+        failures++;
+    } else {
+        printf("ok     %s\n", name);
+    }
+
+    ast_node_free(program);
+    parser_free(parser);
+    token_array_free(tokens);
+}
+
+static void expect_success(const char *name, const char *source) {
+    TokenArray *tokens = tokenize(source);
+    Parser *parser = parser_create(tokens);
+    ASTNode *program = parse_program(parser);
+
+    if (parser->had_error) {
+        printf("FAILED %s: %s\n", name, parser->error);
+        failures++;
+    } else {
+        printf("ok     %s\n", name);
+    }
+
+    ast_node_free(program);
+    parser_free(parser);
+    token_array_free(tokens);
+}
+
+// "let x = <n digits>;" with the literal on line 2
+static char* long_literal(int digits) {
+    char *source = malloc(digits + 32);
+    int length = sprintf(source, "let a = 1;\nlet x = ");
+    memset(source + length, '7', digits);
+    strcpy(source + length + digits, ";\n");
+    return source;
+}
+
+static char* long_identifier(int characters) {
+    char *source = malloc(characters + 32);
+    int length = sprintf(source, "let ");
+    memset(source + length, 'v', characters);
+    strcpy(source + length + characters, " = 1;\n");
+    return source;
+}
+
+int main(void) {
+    char *source = long_literal(400);
+    expect_error("overlong number literal", source, "Number literal longer than 31 characters at line 2, column 9");
+    free(source);
+
+    source = long_literal(MAX_NUMBER_LENGTH);
+    expect_success("longest number literal", source);
+    free(source);
+
+    source = long_identifier(100000);
+    expect_error("overlong identifier", source, "Identifier longer than 63 characters at line 1, column 5");
+    free(source);
+
+    source = long_identifier(MAX_IDENTIFIER_LENGTH);
+    expect_success("longest identifier", source);
+    free(source);
+
+    expect_error("non-ASCII input", "let \xc3\xa9 = 1;", "Expected IDENTIFIER");
+
+    return failures ? 1 : 0;
+}
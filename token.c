@@ -1,14 +1,17 @@
 #include "token.h"
+#include "stats.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 
 TokenArray* token_array_init(int initial_capacity) {
-    TokenArray *array = (TokenArray*)malloc(sizeof(TokenArray));
-    array->tokens = (Token*)malloc(sizeof(Token) * initial_capacity);
+    TokenArray *array = (TokenArray*)stats_malloc(sizeof(TokenArray));
+    array->tokens = (Token*)stats_malloc(sizeof(Token) * initial_capacity);
     array->count = 0;
     array->capacity = initial_capacity;
+    array->had_error = 0;
+    array->error[0] = '\0';
     return array;
 }
 
@@ -16,7 +19,7 @@ void token_array_add(TokenArray *array, Token token) {
     // Resize array if needed
     if (array->count >= array->capacity) {
         array->capacity *= 2;
-        array->tokens = (Token*)realloc(array->tokens, sizeof(Token) * array->capacity);
+        array->tokens = (Token*)stats_realloc(array->tokens, sizeof(Token) * array->capacity);
     }
     
     array->tokens[array->count++] = token;
@@ -44,7 +47,7 @@ Token create_keyword_token(TokenType type) {
 Token create_identifier_token(const char *identifier) {
     Token token;
     token.type = TOKEN_IDENTIFIER;
-    token.value.string_value = strdup(identifier);
+    token.value.string_value = stats_strdup(identifier);
     return token;
 }
 
@@ -98,39 +101,74 @@ char* token_to_string(Token token) {
             sprintf(buffer, "[%s]", token_type_to_string(token.type));
     }
     
-    return strdup(buffer);
+    return stats_strdup(buffer);
+}
+
+static void tokenize_error(TokenArray *tokens, const char *what, int limit, int line, int column) {
+    if (tokens->had_error) return;
+    tokens->had_error = 1;
+    snprintf(tokens->error, sizeof(tokens->error), "%s longer than %d characters at line %d, column %d",
+             what, limit, line, column);
+}
+
+static void tokenize_add(TokenArray *tokens, Token token, int line, int column) {
+    token.line = line;
+    token.column = column;
+    token_array_add(tokens, token);
 }
 
 TokenArray* tokenize(const char *input) {
+    return tokenize_at(input, 1, 1);
+}
+
+TokenArray* tokenize_at(const char *input, int line, int column) {
     TokenArray *tokens = token_array_init(50);
     int i = 0;
+    int line_start = 1 - column;  // Index of the current line's first character
     while (input[i] != '\0') {
-        if (isspace(input[i])) {
+        column = i - line_start + 1;
+        if (isspace((unsigned char)input[i])) {
+            if (input[i] == '\n') {
+                line++;
+                line_start = i + 1;
+            }
             i++;
-        } else if (isalpha(input[i])) {
-            char word[50];
+        } else if (isalpha((unsigned char)input[i])) {
+            char word[MAX_IDENTIFIER_LENGTH + 1];
             int j = 0;
-            while (isalnum(input[i])) {
-                word[j++] = input[i++];
+            while (isalnum((unsigned char)input[i])) {
+                if (j < MAX_IDENTIFIER_LENGTH) word[j] = input[i];
+                j++;
+                i++;
+            }
+            if (j > MAX_IDENTIFIER_LENGTH) {
+                tokenize_error(tokens, "Identifier", MAX_IDENTIFIER_LENGTH, line, column);
+                continue;
             }
             word[j] = '\0';
 
             if (strcmp(word, "let") == 0) {
-                token_array_add(tokens, create_keyword_token(TOKEN_LET));
+                tokenize_add(tokens, create_keyword_token(TOKEN_LET), line, column);
             } else if (strcmp(word, "print") == 0) {
-                token_array_add(tokens, create_keyword_token(TOKEN_PRINT));
+                tokenize_add(tokens, create_keyword_token(TOKEN_PRINT), line, column);
             } else {
-                token_array_add(tokens, create_identifier_token(word));
+                tokenize_add(tokens, create_identifier_token(word), line, column);
             }
-        } else if (isdigit(input[i])) {
+        } else if (isdigit((unsigned char)input[i])) {
             // Read number
-            char number[20];
+            char number[MAX_NUMBER_LENGTH + 1];
             int j = 0;
-            while (isdigit(input[i])) {
-                number[j++] = input[i++];
+            while (isdigit((unsigned char)input[i])) {
+                if (j < MAX_NUMBER_LENGTH) number[j] = input[i];
+                j++;
+                i++;
+            }
+            if (j > MAX_NUMBER_LENGTH) {
+                tokenize_error(tokens, "Number literal", MAX_NUMBER_LENGTH, line, column);
+                continue;
             }
             number[j] = '\0';
-            token_array_add(tokens, create_number_token(atof(number)));
+            tokenize_add(tokens, create_number_token(atof(number)), line, column);
         } else {
             // Single-character tokens
             Token token;
@@ -166,7 +204,7 @@ TokenArray* tokenize(const char *input) {
                     break;
                 }
             }
-            token_array_add(tokens, token);
+            tokenize_add(tokens, token, line, column);
             i++;
         }
     }
@@ -29,13 +29,21 @@ typedef struct {
         double number_value; // For numbers
         char char_value;     // For single-character tokens
     } value;
+    int line;    // 1-based source position of the first character
+    int column;
 } Token;
 
+// Longest identifier and number literal the tokenizer accepts
+#define MAX_IDENTIFIER_LENGTH 63
+#define MAX_NUMBER_LENGTH 31
+
 // Token array
 typedef struct {
     Token *tokens;
     int count;
     int capacity;
+    int had_error;
+    char error[128];  // First tokenizer error, reported by the parser
 } TokenArray;
 
 // Initialize token array
@@ -61,4 +69,7 @@ char* token_to_string(Token token);
 
 TokenArray* tokenize(const char *input);
 
+// Tokenize text that starts at the given line and column of a larger source
+TokenArray* tokenize_at(const char *input, int line, int column);
+
 #endif // TOKEN_H
\ No newline at end of file
@@ -0,0 +1,372 @@
+#include "watch.h"
+#include "process.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+// One top-level statement as it appeared in the last successful build
+typedef struct {
+    char *text;         // Source text up to and including its ';'
+    int line;           // Where text starts in the file
+    int column;
+    ASTNode *ast;       // NULL for a chunk without a statement (trailing whitespace)
+    int *slots;         // Stack offsets the generated code depends on
+    int slot_count;
+    char *code;         // Generated target code
+    size_t code_length;
+    int previous;       // While rebuilding: index of the reused old statement, or -1
+} WatchStatement;
+
+typedef struct {
+    const CompileOptions *options;
+    WatchStatement *statements;
+    int count;
+    char *prologue;
+    size_t prologue_length;
+    char *epilogue;
+    size_t epilogue_length;
+} WatchState;
+
+static double elapsed_ms(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e3 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+// Split source after every ';'. Tokens never span a ';', so each chunk can be
+// tokenized and parsed on its own
+static WatchStatement* watch_split(const char *data, int *count) {
+    int capacity = 16;
+    WatchStatement *statements = malloc(sizeof(WatchStatement) * capacity);
+    *count = 0;
+
+    const char *start = data;
+    int line = 1;
+    int column = 1;
+    while (*start) {
+        const char *end = strchr(start, ';');
+        end = end ? end + 1 : start + strlen(start);
+
+        if (*count >= capacity) {
+            capacity *= 2;
+            statements = realloc(statements, sizeof(WatchStatement) * capacity);
+        }
+        WatchStatement *statement = &statements[(*count)++];
+        memset(statement, 0, sizeof(WatchStatement));
+        statement->text = strndup(start, end - start);
+        statement->line = line;
+        statement->column = column;
+        statement->previous = -1;
+
+        for (const char *p = start; p < end; p++) {
+            if (*p == '\n') {
+                line++;
+                column = 1;
+            } else {
+                column++;
+            }
+        }
+
+        start = end;
+    }
+
+    return statements;
+}
+
+// Parse a single chunk. Returns 0 and sets statement->ast (possibly NULL) on success
+static int watch_parse(WatchStatement *statement, CompileResult *result) {
+    TokenArray *tokens = tokenize_at(statement->text, statement->line, statement->column);
+    Parser *parser = parser_create(tokens);
+    ASTNode *program = parse_program(parser);
+
+    int failed = parser->had_error;
+    if (failed) {
+        snprintf(result->error, sizeof(result->error), "Parser error: %s", parser->error);
+    } else if (program->data.program.statement_count > 0) {
+        statement->ast = program->data.program.statements[0];
+        program->data.program.statement_count = 0;
+    }
+
+    ast_node_free(program);
+    parser_free(parser);
+    token_array_free(tokens);
+    return failed;
+}
+
+static void watch_add_slot(WatchStatement *statement, int slot) {
+    statement->slots = realloc(statement->slots, sizeof(int) * (statement->slot_count + 1));
+    statement->slots[statement->slot_count++] = slot;
+}
+
+static void watch_collect_slots(WatchStatement *statement, ASTNode *node, SymbolTable *table) {
+    switch (node->type) {
+        case AST_IDENTIFIER: {
+            Symbol *symbol = symbol_table_lookup(table, node->data.identifier.name);
+            watch_add_slot(statement, symbol ? symbol->stack_offset : -1);
+            break;
+        }
+        case AST_BINARY_EXPRESSION:
+            watch_collect_slots(statement, node->data.binary_expression.left, table);
+            watch_collect_slots(statement, node->data.binary_expression.right, table);
+            break;
+        case AST_VARIABLE_DECLARATION:
+            watch_collect_slots(statement, node->data.variable_declaration.value, table);
+            watch_add_slot(statement, table->current_offset + 8);
+            break;
+        case AST_PRINT_STATEMENT:
+            watch_collect_slots(statement, node->data.print_statement.expression, table);
+            break;
+        case AST_PROGRAM:
+        case AST_NUMBER:
+            break;
+    }
+}
+
+static void watch_statement_free(WatchStatement *statement) {
+    free(statement->text);
+    ast_node_free(statement->ast);
+    free(statement->slots);
+    free(statement->code);
+}
+
+// Release a rebuilt statement list. Fields borrowed from the old list are left alone
+static void watch_discard(WatchStatement *statements, int count) {
+    for (int i = 0; i < count; i++) {
+        WatchStatement *statement = &statements[i];
+        if (statement->previous < 0) {
+            ast_node_free(statement->ast);
+        }
+        free(statement->text);
+        free(statement->slots);
+        free(statement->code);
+    }
+    free(statements);
+}
+
+typedef struct {
+    int reparsed;
+    int regenerated;
+} WatchCounts;
+
+// Bring the statement list up to date with data. On failure the previous
+// state is kept and result describes the error
+static int watch_update(WatchState *state, const char *data, CompileResult *result, WatchCounts *counts) {
+    int count;
+    WatchStatement *statements = watch_split(data, &count);
+    WatchStatement *old = state->statements;
+    int old_count = state->count;
+
+    // Match unchanged statements against the common prefix and, after an
+    // insertion or removal, the common suffix
+    int prefix = 0;
+    while (prefix < count && prefix < old_count &&
+           strcmp(statements[prefix].text, old[prefix].text) == 0) {
+        prefix++;
+    }
+    int shift = count - old_count;
+
+    for (int i = 0; i < count; i++) {
+        int j = -1;
+        if (i < prefix) {
+            j = i;
+        } else if (i - shift >= prefix && i - shift < old_count &&
+                   strcmp(statements[i].text, old[i - shift].text) == 0) {
+            j = i - shift;
+        }
+
+        if (j >= 0) {
+            statements[i].ast = old[j].ast;
+            statements[i].previous = j;
+        } else {
+            counts->reparsed++;
+            if (watch_parse(&statements[i], result) != 0) {
+                for (int k = i + 1; k < count; k++) free(statements[k].text);
+                watch_discard(statements, i + 1);
+                return 1;
+            }
+        }
+    }
+
+    // Replay declarations in order; a statement keeps its code only when it
+    // reads and writes exactly the same slots as before
+    CodeGenerator *codegen = codegen_create(NULL, state->options->backend);
+    codegen->comments = state->options->comments;
+    for (int i = 0; i < count; i++) {
+        WatchStatement *statement = &statements[i];
+        if (statement->ast == NULL) continue;
+
+        watch_collect_slots(statement, statement->ast, codegen->symbol_table);
+
+        WatchStatement *previous = statement->previous >= 0 ? &old[statement->previous] : NULL;
+        if (previous && previous->code && previous->slot_count == statement->slot_count &&
+            memcmp(previous->slots, statement->slots, sizeof(int) * statement->slot_count) == 0) {
+            statement->code = malloc(previous->code_length + 1);
+            memcpy(statement->code, previous->code, previous->code_length + 1);
+            statement->code_length = previous->code_length;
+            if (statement->ast->type == AST_VARIABLE_DECLARATION) {
+                codegen_declare(codegen, statement->ast->data.variable_declaration.name);
+            }
+            continue;
+        }
+
+        counts->regenerated++;
+        state->options->backend->statement(codegen, statement->ast);
+        statement->code = emitter_take(&codegen->out, &statement->code_length);
+
+        if (codegen->had_error) {
+            snprintf(result->error, sizeof(result->error), "Error: %s", codegen->error);
+            codegen_free(codegen);
+            watch_discard(statements, count);
+            return 1;
+        }
+    }
+    codegen_free(codegen);
+
+    // Commit: the new list takes over borrowed ASTs, everything else of the old one goes
+    for (int i = 0; i < count; i++) {
+        if (statements[i].previous >= 0) {
+            old[statements[i].previous].ast = NULL;
+            statements[i].previous = -1;
+        }
+    }
+    for (int j = 0; j < old_count; j++) {
+        watch_statement_free(&old[j]);
+    }
+    free(old);
+
+    state->statements = statements;
+    state->count = count;
+    return 0;
+}
+
+static int watch_build(WatchState *state, CompileResult *result) {
+    const Backend *backend = state->options->backend;
+
+    BuildJob job = {0};
+    job.output_path = state->options->output_path;
+    job.source_path = state->options->source_path;
+    if (backend->build_begin(&job) != 0) {
+        snprintf(result->error, sizeof(result->error), "%s", job.error);
+        return 1;
+    }
+
+    fwrite(state->prologue, 1, state->prologue_length, job.stream);
+    for (int i = 0; i < state->count; i++) {
+        fwrite(state->statements[i].code, 1, state->statements[i].code_length, job.stream);
+    }
+    fwrite(state->epilogue, 1, state->epilogue_length, job.stream);
+
+    if (backend->build_finish(&job) != 0) {
+        snprintf(result->error, sizeof(result->error), "%s", job.error);
+        return 1;
+    }
+    return 0;
+}
+
+static void watch_rebuild(WatchState *state, const char *file_path, bool run_program) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    char *data = read_file(file_path, NULL);
+    if (data == NULL) {
+        printf("[watch] Error opening file\n");
+        return;
+    }
+
+    CompileResult result = {0};
+    WatchCounts counts = {0};
+    int failed = watch_update(state, data, &result, &counts);
+    free(data);
+    double codegen_ms = elapsed_ms(&start);
+
+    if (failed == 0) {
+        failed = watch_build(state, &result);
+    }
+    double total_ms = elapsed_ms(&start);
+
+    if (failed) {
+        printf("[watch] %s\n", result.error);
+        fflush(stdout);
+        return;
+    }
+
+    int statement_count = 0;
+    for (int i = 0; i < state->count; i++) {
+        statement_count += state->statements[i].ast != NULL;
+    }
+    printf("[watch] %d statements: %d reparsed, %d regenerated in %.3f ms, built in %.3f ms\n",
+           statement_count, counts.reparsed, counts.regenerated, codegen_ms, total_ms);
+
+    if (run_program) {
+        const char *output_path = state->options->output_path;
+        char run_path[PATH_MAX];
+        snprintf(run_path, sizeof(run_path), "%s%s", strchr(output_path, '/') ? "" : "./", output_path);
+        char *run_argv[] = {run_path, NULL};
+        fflush(stdout);
+        process_run(run_argv);
+    }
+    fflush(stdout);
+}
+
+int watch_run(const char *file_path, const CompileOptions *options, bool run_program) {
+    WatchState state = {0};
+    state.options = options;
+
+    // Prologue and epilogue never change, so generate them once
+    CodeGenerator *codegen = codegen_create(NULL, options->backend);
+    options->backend->prologue(codegen);
+    state.prologue = emitter_take(&codegen->out, &state.prologue_length);
+    options->backend->epilogue(codegen);
+    state.epilogue = emitter_take(&codegen->out, &state.epilogue_length);
+    codegen_free(codegen);
+
+    // Watch the directory: editors often save by renaming a new file over the old one
+    char directory[PATH_MAX];
+    snprintf(directory, sizeof(directory), "%s", file_path);
+    char *slash = strrchr(directory, '/');
+    const char *name = slash ? file_path + (slash - directory) + 1 : file_path;
+    if (slash) {
+        *(slash == directory ? slash + 1 : slash) = '\0';
+    } else {
+        strcpy(directory, ".");
+    }
+
+    int fd = inotify_init1(IN_CLOEXEC);
+    if (fd < 0 || inotify_add_watch(fd, directory, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        printf("Error watching %s\n", directory);
+        return 1;
+    }
+
+    printf("[watch] watching %s\n", file_path);
+    watch_rebuild(&state, file_path, run_program);
+
+    char buffer[sizeof(struct inotify_event) + NAME_MAX + 1] __attribute__((aligned(__alignof__(struct inotify_event))));
+    for (;;) {
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        int changed = 0;
+        for (char *p = buffer; p < buffer + n; ) {
+            struct inotify_event *event = (struct inotify_event*)p;
+            if (event->len > 0 && strcmp(event->name, name) == 0) {
+                changed = 1;
+            }
+            p += sizeof(struct inotify_event) + event->len;
+        }
+
+        if (changed) {
+            watch_rebuild(&state, file_path, run_program);
+        }
+    }
+
+    close(fd);
+    return 1;
+}
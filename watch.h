@@ -0,0 +1,13 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <stdbool.h>
+#include "compiler.h"
+
+// Rebuild file_path every time it is saved, until interrupted. Statements
+// whose text and variable slots are unchanged keep their AST and generated
+// code from the previous build; only the rest are re-parsed or re-generated.
+// The program is run after each successful build when run_program is set
+int watch_run(const char *file_path, const CompileOptions *options, bool run_program);
+
+#endif // WATCH_H